@@ -0,0 +1,66 @@
+#include "FrameProfiler.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+void FrameProfiler::begin_frame() {
+	frame_start = phase_start = Clock::now();
+	current.fill(0.0f);
+}
+
+void FrameProfiler::end_phase(Phase phase) {
+	Clock::time_point now = Clock::now();
+	current[phase] += std::chrono::duration< float >(now - phase_start).count();
+	phase_start = now;
+}
+
+void FrameProfiler::end_frame() {
+	float total = std::chrono::duration< float >(Clock::now() - frame_start).count();
+
+	uint32_t slot = uint32_t(frames % HistorySize);
+	for (uint32_t p = 0; p < PhaseCount; ++p) {
+		history[p][slot] = current[p];
+	}
+	history[PhaseCount][slot] = total;
+
+	frames += 1;
+	if (total > missed_frame_seconds) missed_frames += 1;
+}
+
+void FrameProfiler::report(std::ostream &out) const {
+	static const char *names[PhaseCount + 1] = { "events", "update", "draw", "swap", "frame" };
+
+	uint32_t count = uint32_t(std::min< uint64_t >(frames, HistorySize));
+	if (count == 0) {
+		out << "Frame profile: no frames recorded." << std::endl;
+		return;
+	}
+
+	out << "Frame profile (last " << count << " of " << frames << " frames; "
+		<< missed_frames << " frames over " << (missed_frame_seconds * 1000.0f) << "ms):\n";
+	out << "  " << std::left << std::setw(8) << "phase" << std::right
+		<< std::setw(10) << "p50 ms" << std::setw(10) << "p95 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << "\n";
+
+	std::ios::fmtflags old_flags = out.flags();
+	std::streamsize old_precision = out.precision();
+
+	std::vector< float > sorted(count);
+	for (uint32_t p = 0; p < PhaseCount + 1; ++p) {
+		std::copy(history[p].begin(), history[p].begin() + count, sorted.begin());
+		std::sort(sorted.begin(), sorted.end());
+		auto percentile = [&](float f) {
+			return 1000.0f * sorted[std::min(count - 1, uint32_t(f * count))];
+		};
+		out << "  " << std::left << std::setw(8) << names[p] << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(10) << percentile(0.50f)
+			<< std::setw(10) << percentile(0.95f)
+			<< std::setw(10) << percentile(0.99f)
+			<< std::setw(10) << 1000.0f * sorted.back() << "\n";
+	}
+	out << std::flush;
+
+	out.flags(old_flags);
+	out.precision(old_precision);
+}
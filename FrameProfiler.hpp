@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+ * FrameProfiler -- records how long each phase of the main loop takes.
+ *
+ * Every frame, call begin_frame(), then end_phase() after each phase, then end_frame():
+ *  phase durations go into a fixed-size ring buffer (so recording never allocates),
+ *  and report() prints p50/p95/p99/max over the buffered frames plus a count of missed frames.
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+struct FrameProfiler {
+	enum Phase : uint32_t {
+		Events, //event polling + handle_event
+		Update, //Mode::update
+		Draw, //Mode::draw
+		Swap, //SDL_GL_SwapWindow (includes waiting for vsync)
+		PhaseCount
+	};
+
+	//number of frames kept for percentiles:
+	enum : uint32_t { HistorySize = 1024 };
+
+	//frames that take longer than this (in seconds) are counted as 'missed':
+	// (default is 1.5x a 60Hz frame, so vsync jitter doesn't count)
+	float missed_frame_seconds = 1.5f / 60.0f;
+
+	void begin_frame();
+	void end_phase(Phase phase); //time since begin_frame() or the previous end_phase() is charged to 'phase'
+	void end_frame();
+
+	void report(std::ostream &out) const;
+
+	//------ internals ------
+	typedef std::chrono::high_resolution_clock Clock;
+	Clock::time_point frame_start;
+	Clock::time_point phase_start;
+
+	//seconds per phase (and, in the last row, per whole frame) for the most recent frames:
+	std::array< std::array< float, HistorySize >, PhaseCount + 1 > history{};
+	std::array< float, PhaseCount > current{}; //phase times for the frame in progress
+
+	uint64_t frames = 0; //total frames recorded
+	uint64_t missed_frames = 0; //total frames longer than missed_frame_seconds
+};
@@ -1,71 +1,169 @@
 #include "PPU466.hpp"
+#include "tile_codec.hpp"
 
 #include "Load.hpp"
 #include "GL.hpp"
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
+#include "gl_state.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
 #include <vector>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <stdexcept>
 
 //In order to implement the PPU466 on modern graphics hardware, a fancy, special purpose tile-drawing shader is used:
+// (sprites are drawn as instances of a quad; each instance reads one PPU466::Sprite record directly)
+// (the programs are shared by all PPU configurations; the TILE_MASK and PALETTE_MASK uniforms
+//  pass the configuration's tile and palette counts, minus one)
 struct PPUTileProgram {
 	PPUTileProgram();
 	~PPUTileProgram();
 
 	GLuint program = 0;
 
-	//Attribute (per-vertex variable) locations:
-	GLuint Position_vec2 = -1U;
-	GLuint TileCoord_ivec2 = -1U;
-	GLuint Palette_int = -1U;
+	//Attribute (per-instance variable) locations:
+	GLuint Sprite_uvec4 = -1U;
 
 	//Uniform (per-invocation variable) locations:
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
+	GLuint PRIORITY_uint = -1U;
+	GLuint TILE_MASK_uint = -1U;
+	GLuint PALETTE_MASK_uint = -1U;
 
 	//Textures bindings:
-	//TEXTURE0 - the tile table (as a 128x128 R8UI texture)
-	//TEXTURE1 - the palette table (as a 4x8 RGBA8 texture)
+	//TEXTURE0 - the tile table (as a 128x(TileCount/2) R8UI texture)
+	//TEXTURE1 - the palette table (as a 4xPaletteCount RGBA8 texture)
 };
 
 //Initialize tile program and associated buffers:
 Load< PPUTileProgram > tile_program(LoadTagEarly); //will 'new PPUTileProgram()' by default
 
+//The background is drawn as a single screen-covering quad by a tilemap shader:
+// (the shader does background scrolling + wrapping and looks up tiles directly from the background texture)
+struct PPUBackgroundProgram {
+	PPUBackgroundProgram();
+	~PPUBackgroundProgram();
+
+	GLuint program = 0;
+
+	//No attributes -- the quad's corners are computed from gl_VertexID.
+
+	//Uniform (per-invocation variable) locations:
+	GLuint SCREEN_SIZE_ivec2 = -1U;
+	GLuint BACKGROUND_POSITION_ivec2 = -1U;
+	GLuint TILE_MASK_uint = -1U;
+	GLuint PALETTE_MASK_uint = -1U;
+
+	//Textures bindings:
+	//TEXTURE0 - the tile table (as a 128x(TileCount/2) R8UI texture)
+	//TEXTURE1 - the palette table (as a 4xPaletteCount RGBA8 texture)
+	//TEXTURE2 - the background (as a BackgroundWidth x BackgroundHeight R16UI texture)
+};
+
+Load< PPUBackgroundProgram > background_program(LoadTagEarly);
+
+//Per-draw data (sprite records) is streamed through a ring of space inside one large buffer:
+// - each write goes to the next free range and is mapped with GL_MAP_UNSYNCHRONIZED_BIT,
+//   so the driver never has to orphan the buffer or wait for the GPU;
+// - after the draws that read a range are issued, fence() inserts a fence for it,
+//   and write() only waits when it is about to overwrite a range whose fence hasn't signaled yet.
+struct PPUStreamRing {
+	PPUStreamRing();
+	~PPUStreamRing();
+
+	//total size of the ring; must hold several frames' worth of data:
+	enum : uint32_t { Size = 64 * 1024 };
+
+	//copies 'size' bytes from 'data' into the ring and returns the offset (in 'buffer') at which they were stored:
+	// (leaves 'buffer' bound to GL_ARRAY_BUFFER)
+	GLintptr write(void const *data, GLsizeiptr size);
+
+	//mark everything written since the last call to fence() as in use by draws that have been issued:
+	void fence();
+
+	GLuint buffer = 0;
+
+	//next offset to write at:
+	GLintptr head = 0;
+	//start of the data that has been written but not yet fenced:
+	GLintptr unfenced_begin = 0;
+
+	//fenced ranges the GPU may still be reading, oldest first:
+	// (a range with end < begin wraps around the end of the buffer)
+	struct InFlight {
+		GLsync fence;
+		GLintptr begin, end;
+	};
+	std::deque< InFlight > in_flight;
+};
+
 //PPU data is streamed to the GPU (read: uploaded 'just in time') using a few buffers:
+// (each PPU configuration has its own set, sized to match)
+template< typename Config >
 struct PPUDataStream {
 	PPUDataStream();
 	~PPUDataStream();
 
-	//vertex format for convenience:
-	struct Vertex {
-		Vertex(glm::ivec2 const &Position_, glm::ivec2 const &TileCoord_, int32_t const &Palette_)
-			: Position(Position_), TileCoord(TileCoord_), Palette(Palette_) { }
-		//I generally make class members lowercase, but I make an exception here because
-		// I use uppercase for vertex attributes in shader programs and want to match.
-		glm::ivec2 Position;
-		glm::ivec2 TileCoord;
-		int32_t Palette;
+	typedef BasicPPU< Config > PPU;
+
+	//tiles are stored in the tile texture in rows of 16:
+	enum : uint32_t {
+		TileTextureWidth = 16 * 8,
+		TileTextureHeight = (PPU::TileCount / 16) * 8
 	};
 
-	//vertex buffer that will store data stream:
-	GLuint vertex_buffer = 0;
+	//ring buffer that will store the sprite records (one per instance):
+	// ('mutable' because streaming changes ring state through the const data_stream pointer)
+	mutable PPUStreamRing sprite_ring;
 
-	//vertex array object that maps tile program attributes to vertex storage:
-	GLuint vertex_buffer_for_tile_program = 0;
+	//vertex array object that maps tile program attributes to sprite storage:
+	GLuint sprite_buffer_for_tile_program = 0;
 
 	//texture object that will store tile table:
 	GLuint tile_tex = 0;
 
+	//copy of the tile table as last uploaded to tile_tex:
+	// (BasicPPU::draw compares against this to decode + upload only the tiles that changed)
+	// (these are 'mutable' because the data stream is only available through a const pointer)
+	mutable std::array< PPUTypes::Tile, PPU::TileCount > uploaded_tiles;
+	mutable bool uploaded_tiles_valid = false; //false until tile_tex has been filled once
+
 	//texture object that will store palette table:
 	GLuint palette_tex = 0;
+
+	//copy of the palette table as last uploaded to palette_tex:
+	mutable std::array< PPUTypes::Palette, PPU::PaletteCount > uploaded_palettes;
+	mutable bool uploaded_palettes_valid = false; //false until palette_tex has been filled once
+
+	//texture object that will store the background:
+	GLuint background_tex = 0;
+
+	//copy of the background as last uploaded to background_tex:
+	mutable std::array< uint16_t, PPU::BackgroundWidth * PPU::BackgroundHeight > uploaded_background;
+	mutable bool uploaded_background_valid = false; //false until background_tex has been filled once
+
+	//vertex array object with no attributes, used when drawing the background quad:
+	GLuint empty_vertex_array = 0;
+
+	//native-resolution (ScreenWidth x ScreenHeight) render target used when draw_offscreen is set:
+	GLuint offscreen_color_tex = 0;
+	GLuint offscreen_framebuffer = 0;
+	mutable bool offscreen_valid = false; //true once a frame has been drawn into it
 };
 
-Load< PPUDataStream > data_stream(LoadTagDefault);
+template< typename Config >
+Load< PPUDataStream< Config > > data_stream(LoadTagDefault);
 
 //-------------------------------------------------------------------
 
-PPU466::PPU466() {
+template< typename Config >
+BasicPPU< Config >::BasicPPU() {
 	for (auto &palette : palette_table) {
 		palette[0] = glm::u8vec4(0x00, 0x00, 0x00, 0x00);
 		palette[1] = glm::u8vec4(0x44, 0x44, 0x44, 0xff);
@@ -80,22 +178,90 @@ PPU466::PPU466() {
 
 	for (uint32_t i = 0; i < background.size(); ++i) {
 		background[i] = int16_t(
-			  (i % 8) << 8 //cycle through all palettes
+			  (i % PaletteCount) << 8 //cycle through all palettes
 			| (i % palette_table.size()) //cycle through all tiles
 		);
 	}
 }
 
-void PPU466::draw(glm::uvec2 const &drawable_size) const {
+template< typename Config >
+uint32_t BasicPPU< Config >::list_sprites(SpriteList *list_) const {
+	assert(list_);
+	auto &list = *list_;
+
+	std::copy(sprites.begin(), sprites.end(), list.begin());
+	uint32_t count = SpriteCount;
+
+	//expand metasprites into sprites, skipping tiles that would be off-screen:
+	for (Metasprite const &meta : metasprites) {
+		if (meta.y >= ScreenHeight || meta.tile_indices == nullptr) continue;
+		const uint32_t cols = meta.width / 8;
+		const uint32_t rows = meta.height / 8;
+		for (uint32_t r = 0; r < rows; ++r) {
+			const uint32_t y = uint32_t(meta.y) + 8 * r;
+			if (y >= ScreenHeight) break; //rows only go up from here
+			for (uint32_t c = 0; c < cols; ++c) {
+				const uint32_t x = uint32_t(meta.x) + 8 * c;
+				if (x >= ScreenWidth) continue;
+				if (count == list.size()) return count; //out of metasprite tiles
+				const uint32_t t = r * cols + c;
+				Sprite &sprite = list[count++];
+				sprite.x = uint8_t(x);
+				sprite.y = uint8_t(y);
+				sprite.index = meta.tile_indices[t];
+				sprite.attributes = meta.attributes;
+				if (meta.tile_flips) sprite.attributes ^= (meta.tile_flips[t] & FlipMask);
+			}
+		}
+	}
+
+	return count;
+}
+
+template< typename Config >
+typename BasicPPU< Config >::Framebuffer *BasicPPU< Config >::headless_framebuffer = nullptr;
+
+PPUTypes::UploadCounters PPUTypes::upload_counters;
+
+template< typename Config >
+bool BasicPPU< Config >::read_offscreen(Framebuffer *framebuffer) const {
+	assert(framebuffer);
+	//in headless mode, the last frame is already in memory:
+	if (headless_framebuffer) {
+		*framebuffer = *headless_framebuffer;
+		return true;
+	}
+	if (!data_stream< Config >->offscreen_valid) return false;
+
+	GLuint old_read_framebuffer = gl_state.get_read_framebuffer();
+	gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, data_stream< Config >->offscreen_framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, ScreenWidth, ScreenHeight, GL_RGBA, GL_UNSIGNED_BYTE, framebuffer->data());
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, old_read_framebuffer);
+
+	GL_ERRORS();
+	return true;
+}
+
+template< typename Config >
+void BasicPPU< Config >::draw(glm::uvec2 const &drawable_size) const {
+	//in headless mode there is no OpenGL context, so draw on the CPU:
+	if (headless_framebuffer) {
+		draw_software(headless_framebuffer);
+		return;
+	}
+
 	//this code does screen scaling by manipulating the viewport, so save old values:
+	// (GL state goes through gl_state, which knows the viewport without a synchronous glGetIntegerv)
 	GLint old_viewport[4];
-	glGetIntegerv(GL_VIEWPORT, old_viewport);
+	gl_state.get_viewport(old_viewport);
 
 	//draw to whole drawable:
-	glViewport(0,0,drawable_size.x,drawable_size.y);
+	gl_state.viewport(0,0,drawable_size.x,drawable_size.y);
 
 	//background gets background color:
-	glClearColor(
+	gl_state.clear_color(
 		background_color.r / 255.0f, 
 		background_color.g / 255.0f, 
 		background_color.b / 255.0f,
@@ -104,152 +270,181 @@ void PPU466::draw(glm::uvec2 const &drawable_size) const {
 	glClear(GL_COLOR_BUFFER_BIT);
 
 	//set up screen scaling:
+	// (the PPU's screen will cover [lower_left, lower_left + size) in the drawable)
+	glm::ivec2 lower_left = glm::ivec2(0,0);
+	glm::ivec2 size = glm::ivec2(drawable_size);
 	if (drawable_size.x < ScreenWidth || drawable_size.y < ScreenHeight) {
 		//if screen is too small, just do some inglorious pixel-mushing:
-		//(viewport is already set. nothing more to do.)
+		//(whole drawable is used. nothing more to do.)
 	} else {
 		//otherwise, do careful integer-multiple upscaling:
 		//largest size that will fit in the drawable:
 		const uint32_t scale = std::max( 1U, std::min(drawable_size.x / ScreenWidth, drawable_size.y / ScreenHeight) );
 
 		//compute lower left so that screen is centered:
-		const glm::ivec2 lower_left = glm::ivec2(
-			(int32_t(drawable_size.x) - scale * int32_t(ScreenWidth)) / 2,
-			(int32_t(drawable_size.y) - scale * int32_t(ScreenHeight)) / 2
+		size = glm::ivec2(scale * ScreenWidth, scale * ScreenHeight);
+		lower_left = glm::ivec2(
+			(int32_t(drawable_size.x) - size.x) / 2,
+			(int32_t(drawable_size.y) - size.y) / 2
 		);
-		glViewport(lower_left.x, lower_left.y, scale * ScreenWidth, scale * ScreenHeight);
 	}
 
-	//build triangle strip representing background and sprites:
-
-	constexpr uint32_t TristripSize = uint32_t(6 * (BackgroundWidth * BackgroundHeight + decltype(sprites)().size()));
-	std::vector< PPUDataStream::Vertex > triangle_strip;
-	triangle_strip.reserve(TristripSize);
-
-	//helper to put a single tile somewhere on the screen:
-	auto draw_tile = [&triangle_strip](glm::ivec2 const &lower_left, uint8_t tile_index, uint8_t palette_index){
-		//convert tile index to lower-left pixel coordinate in tile image:
-		glm::ivec2 tile_coord = glm::ivec2((tile_index % 16)*8, (tile_index / 16)*8);
-
-		//build a quad as a (very short) triangle strip that starts and ends with degenerate triangles:
-		triangle_strip.emplace_back(glm::ivec2(lower_left.x+0, lower_left.y+0), glm::ivec2(tile_coord.x+0, tile_coord.y+0), palette_index);
-		triangle_strip.emplace_back(triangle_strip.back());
-		triangle_strip.emplace_back(glm::ivec2(lower_left.x+0, lower_left.y+8), glm::ivec2(tile_coord.x+0, tile_coord.y+8), palette_index);
-		triangle_strip.emplace_back(glm::ivec2(lower_left.x+8, lower_left.y+0), glm::ivec2(tile_coord.x+8, tile_coord.y+0), palette_index);
-		triangle_strip.emplace_back(glm::ivec2(lower_left.x+8, lower_left.y+8), glm::ivec2(tile_coord.x+8, tile_coord.y+8), palette_index);
-		triangle_strip.emplace_back(triangle_strip.back());
-	};
-
-	//helper to draw the sprite list (used because we need to draw the 'behind' sprites, then the background, then the 'front' sprites:
-	auto draw_sprites = [this,&draw_tile](uint8_t priority) {
-		for (auto const &sprite : sprites) {
-			if ((sprite.attributes & 0x80) != priority) continue;
-			draw_tile(
-				glm::ivec2(sprite.x, sprite.y),
-				sprite.index,
-				sprite.attributes & 0x07 //just the palette index part
-			);
-		}
-	};
-
-	draw_sprites(0x80); //draw sprites with priority == 1 ('behind' sprites)
-
-	{ //draw the background:
-		//To simulate the 'infinite tiling' behavior this code draws the background as four screen-sized chunks,
-		// each of which is drawn at an offset that causes it to overlap the screen.
-
-		static_assert(BackgroundWidth * 8 == ScreenWidth * 2, "Background should be exactly twice the screen width.");
-		static_assert(BackgroundHeight * 8 == ScreenHeight * 2, "Background should be exactly twice the screen height.");
-
-		for (int32_t chunk_y : {0, int32_t(ScreenHeight)}) {
-			for (int32_t chunk_x : {0, int32_t(ScreenWidth)}) {
-				//position of the lower-left corner of the chunk:
-				glm::ivec2 pos = glm::ivec2(chunk_x, chunk_y) + background_position;
-
-				constexpr int32_t BackgroundWidthPixels = int32_t(BackgroundWidth) * 8;
-				constexpr int32_t BackgroundHeightPixels = int32_t(BackgroundHeight) * 8;
-
-				//reduce to (-BackgroundWidthPixels,0] x (-BackgroundHeightPixels,0]:
-				pos.x = ((pos.x % BackgroundWidthPixels) - BackgroundWidthPixels) % BackgroundWidthPixels;
-				pos.y = ((pos.y % BackgroundHeightPixels) - BackgroundHeightPixels) % BackgroundHeightPixels;
-
-				//move chunk if it doesn't overlap the screen:
-				if (pos.x + int32_t(ScreenWidth) <= 0) pos.x += BackgroundWidthPixels;
-				if (pos.y + int32_t(ScreenHeight) <= 0) pos.y += BackgroundHeightPixels;
-
-				int32_t ox = chunk_x / 8;
-				int32_t oy = chunk_y / 8;
-				for (int32_t y = 0; y < int32_t(BackgroundHeight)/2; ++y) {
-					for (int32_t x = 0; x < int32_t(BackgroundWidth)/2; ++x) {
-						uint16_t info = background[(x + ox) + BackgroundWidth * (y + oy)];
-						draw_tile(
-							glm::ivec2(pos.x + 8*x, pos.y + 8*y),
-							info & 0xff, //extract tile index bits
-							(info >> 8) & 0x07 //extract palette index bits
-						);
-					}
-				}
-
-			}
-		}
+	GLuint old_draw_framebuffer = 0;
+	GLuint old_read_framebuffer = 0;
+	if (draw_offscreen) {
+		//draw at native resolution into the offscreen framebuffer (it is scaled up at the end of this function):
+		old_draw_framebuffer = gl_state.get_draw_framebuffer();
+		old_read_framebuffer = gl_state.get_read_framebuffer();
+		gl_state.bind_framebuffer(GL_FRAMEBUFFER, data_stream< Config >->offscreen_framebuffer);
+		gl_state.viewport(0, 0, ScreenWidth, ScreenHeight);
+		glClear(GL_COLOR_BUFFER_BIT); //(clear color is still set to the background color)
+	} else {
+		gl_state.viewport(lower_left.x, lower_left.y, size.x, size.y);
 	}
 
-	draw_sprites(0x00); //draw sprites with priority == 0 ('in front' sprites)
-
-	assert(triangle_strip.size() == TristripSize && "Triangle strip size was estimated exactly.");
-
 	//-------------------------------------------------
 	//Upload at to GPU using PPUDataStream:
 
-	{ //upload palette texture:
+	{ //upload changed palettes to palette texture:
 		static_assert(sizeof(palette_table) == 4 * 4 * decltype(palette_table)().size(), "palette table is packed");
-		glBindTexture(GL_TEXTURE_2D, data_stream->palette_tex);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 4, GLsizei(palette_table.size()), 0, GL_RGBA, GL_UNSIGNED_BYTE, palette_table.data());
-		glBindTexture(GL_TEXTURE_2D, 0);
+		static_assert(sizeof(palette_table) == sizeof(PPUDataStream< Config >::uploaded_palettes), "uploaded_palettes mirrors the whole palette table");
+
+		//each palette is one row of the texture; upload each run of changed rows with one call:
+		// (textures are updated on the units they are drawn from, so binding them for drawing is free)
+		bool bound = false;
+		for (uint32_t begin = 0; begin < palette_table.size(); ) {
+			if (data_stream< Config >->uploaded_palettes_valid && palette_table[begin] == data_stream< Config >->uploaded_palettes[begin]) {
+				begin += 1;
+				continue;
+			}
+			uint32_t end = begin + 1;
+			while (end < palette_table.size() && !(data_stream< Config >->uploaded_palettes_valid && palette_table[end] == data_stream< Config >->uploaded_palettes[end])) {
+				end += 1;
+			}
+			std::copy(palette_table.begin() + begin, palette_table.begin() + end, data_stream< Config >->uploaded_palettes.begin() + begin);
+
+			if (!bound) {
+				gl_state.active_texture(GL_TEXTURE1);
+				gl_state.bind_texture(GL_TEXTURE_2D, data_stream< Config >->palette_tex);
+				bound = true;
+			}
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, begin, 4, end - begin, GL_RGBA, GL_UNSIGNED_BYTE, palette_table.data() + begin);
+			upload_counters.palette_uploads += 1;
+			upload_counters.palettes += end - begin;
+
+			begin = end;
+		}
+		data_stream< Config >->uploaded_palettes_valid = true;
 	}
 
-	{ //build + upload tile table texture:
-		//interpret tiles and build a 128 x 128 index texture:
-		static std::array< uint8_t, 128 * 128 > data;
+	{ //upload changed tiles to tile table texture:
+		static_assert(sizeof(tile_table) == sizeof(PPUDataStream< Config >::uploaded_tiles), "uploaded_tiles mirrors the whole tile table");
+
+		//find tiles that differ from what is already in the texture:
+		std::array< uint16_t, TileCount > dirty;
+		uint32_t dirty_count = 0;
 		for (uint32_t i = 0; i < tile_table.size(); ++i) {
 			Tile const &tile = tile_table[i];
-
-			//location of tile in the texture:
-			uint32_t ox = (i % 16) * 8;
-			uint32_t oy = (i / 16) * 8;
-
-			//copy tile indices into texture:
-			for (uint32_t y = 0; y < 8; ++y) {
-				for (uint32_t x = 0; x < 8; ++x) {
-					data[ox+x + 128 * (oy+y)] =
-						  ((tile.bit0[y] >> x) & 1)
-						| ((tile.bit1[y] >> x) & 1) << 1;
+			Tile &uploaded = data_stream< Config >->uploaded_tiles[i];
+			if (data_stream< Config >->uploaded_tiles_valid && tile.bit0 == uploaded.bit0 && tile.bit1 == uploaded.bit1) continue;
+			uploaded = tile;
+			dirty[dirty_count++] = uint16_t(i);
+		}
+		data_stream< Config >->uploaded_tiles_valid = true;
+
+		if (dirty_count > 0) {
+			gl_state.active_texture(GL_TEXTURE0);
+			gl_state.bind_texture(GL_TEXTURE_2D, data_stream< Config >->tile_tex);
+			if (dirty_count > tile_table.size() / 4) {
+				//lots of changes (e.g., first frame): rebuild and upload the whole index texture:
+				constexpr uint32_t Width = PPUDataStream< Config >::TileTextureWidth;
+				constexpr uint32_t Height = PPUDataStream< Config >::TileTextureHeight;
+				static std::array< uint8_t, Width * Height > data;
+				for (uint32_t i = 0; i < tile_table.size(); ++i) {
+					//location of tile in the texture:
+					uint32_t ox = (i % 16) * 8;
+					uint32_t oy = (i / 16) * 8;
+					decode_tile(tile_table[i], &data[ox + Width * oy], Width);
+				}
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, Width, Height, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data.data());
+				upload_counters.tile_uploads += 1;
+			} else {
+				//a few changes: upload just the changed 8 x 8 regions:
+				std::array< uint8_t, 8 * 8 > data;
+				for (uint32_t d = 0; d < dirty_count; ++d) {
+					uint32_t i = dirty[d];
+					decode_tile(tile_table[i], data.data(), 8);
+					glTexSubImage2D(GL_TEXTURE_2D, 0, (i % 16) * 8, (i / 16) * 8, 8, 8, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data.data());
 				}
+				upload_counters.tile_uploads += dirty_count;
 			}
+			upload_counters.tiles += dirty_count;
 		}
+	}
 
-		glBindTexture(GL_TEXTURE_2D, data_stream->tile_tex);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 128, 128, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data.data());
-		glBindTexture(GL_TEXTURE_2D, 0);
+	{ //upload background texture if it changed:
+		static_assert(sizeof(background) == sizeof(PPUDataStream< Config >::uploaded_background), "uploaded_background mirrors the whole background");
+
+		//find the range of rows that differ from what is already in the texture:
+		uint32_t begin_row = BackgroundHeight;
+		uint32_t end_row = 0;
+		for (uint32_t y = 0; y < BackgroundHeight; ++y) {
+			uint16_t const *row = &background[BackgroundWidth * y];
+			uint16_t *uploaded_row = &data_stream< Config >->uploaded_background[BackgroundWidth * y];
+			if (data_stream< Config >->uploaded_background_valid && std::equal(row, row + BackgroundWidth, uploaded_row)) continue;
+			std::copy(row, row + BackgroundWidth, uploaded_row);
+			begin_row = std::min(begin_row, y);
+			end_row = y + 1;
+		}
+		data_stream< Config >->uploaded_background_valid = true;
+
+		if (begin_row < end_row) {
+			gl_state.active_texture(GL_TEXTURE2);
+			gl_state.bind_texture(GL_TEXTURE_2D, data_stream< Config >->background_tex);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, begin_row, BackgroundWidth, end_row - begin_row, GL_RED_INTEGER, GL_UNSIGNED_SHORT, &background[BackgroundWidth * begin_row]);
+			upload_counters.background_uploads += 1;
+			upload_counters.background_rows += end_row - begin_row;
+		}
 	}
 
-	{ //upload vertex data:
-		glBindBuffer(GL_ARRAY_BUFFER, data_stream->vertex_buffer);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(decltype(triangle_strip[0])) * triangle_strip.size(), triangle_strip.data(), GL_STREAM_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//this frame's sprites -- 'sprites' plus expanded metasprites:
+	SpriteList sprite_list;
+	const uint32_t sprite_count = list_sprites(&sprite_list);
+
+	{ //upload sprite records:
+		// (these are used as-is; the tile program expands each one into a quad)
+		GLintptr offset = data_stream< Config >->sprite_ring.write(sprite_list.data(), sprite_count * sizeof(Sprite));
+
+		//point the sprite attribute at this frame's copy of the records:
+		gl_state.bind_vertex_array(data_stream< Config >->sprite_buffer_for_tile_program);
+		glVertexAttribIPointer(
+			tile_program->Sprite_uvec4, //attribute
+			4, //size
+			GL_UNSIGNED_BYTE, //type
+			sizeof(Sprite), //stride
+			(GLbyte *)0 + offset //offset
+		);
 	}
 
 	//set up the pipeline:
 	// set blending function for output fragments:
-	glEnable(GL_BLEND);
-	glBlendEquation(GL_FUNC_ADD);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl_state.enable(GL_BLEND);
+	gl_state.blend_equation(GL_FUNC_ADD);
+	gl_state.blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	// bind texture units to proper texture objects:
+	gl_state.active_texture(GL_TEXTURE2);
+	gl_state.bind_texture(GL_TEXTURE_2D, data_stream< Config >->background_tex);
+	gl_state.active_texture(GL_TEXTURE1);
+	gl_state.bind_texture(GL_TEXTURE_2D, data_stream< Config >->palette_tex);
+	gl_state.active_texture(GL_TEXTURE0);
+	gl_state.bind_texture(GL_TEXTURE_2D, data_stream< Config >->tile_tex);
 
 	// set the shader programs:
-	glUseProgram(tile_program->program);
+	gl_state.use_program(tile_program->program);
 
 	// configure attribute streams:
-	glBindVertexArray(data_stream->vertex_buffer_for_tile_program);
+	gl_state.bind_vertex_array(data_stream< Config >->sprite_buffer_for_tile_program);
 
 	// set uniforms for shader programs:
 	{ //set matrix to transform [0,ScreenWidth]x[0,ScreenHeight] -> [-1,1]x[-1,1]:
@@ -262,29 +457,62 @@ void PPU466::draw(glm::uvec2 const &drawable_size) const {
 		);
 		glUniformMatrix4fv(tile_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(OBJECT_TO_CLIP));
 	}
+	glUniform1ui(tile_program->TILE_MASK_uint, TileCount - 1);
+	glUniform1ui(tile_program->PALETTE_MASK_uint, PaletteCount - 1);
 
-	// bind texture units to proper texture objects:
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, data_stream->palette_tex);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, data_stream->tile_tex);
+	//now that the pipeline is configured, trigger drawing of sprites with priority == 1 ('behind' sprites):
+	// (sprites with the other priority are collapsed to nothing by the vertex shader)
+	glUniform1ui(tile_program->PRIORITY_uint, 0x80);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(sprite_count));
+
+	{ //draw the background as one screen-covering quad:
+		gl_state.use_program(background_program->program);
+		gl_state.bind_vertex_array(data_stream< Config >->empty_vertex_array);
+
+		constexpr int32_t BackgroundWidthPixels = int32_t(BackgroundWidth) * 8;
+		constexpr int32_t BackgroundHeightPixels = int32_t(BackgroundHeight) * 8;
 
-	//now that the pipeline is configured, trigger drawing of triangle strip:
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, GLsizei(triangle_strip.size()));
+		//reduce position to [0,BackgroundWidthPixels) x [0,BackgroundHeightPixels) so the shader only needs to deal with positive values:
+		glm::ivec2 position = glm::ivec2(
+			((background_position.x % BackgroundWidthPixels) + BackgroundWidthPixels) % BackgroundWidthPixels,
+			((background_position.y % BackgroundHeightPixels) + BackgroundHeightPixels) % BackgroundHeightPixels
+		);
+		glUniform2i(background_program->SCREEN_SIZE_ivec2, ScreenWidth, ScreenHeight);
+		glUniform2i(background_program->BACKGROUND_POSITION_ivec2, position.x, position.y);
+		glUniform1ui(background_program->TILE_MASK_uint, TileCount - 1);
+		glUniform1ui(background_program->PALETTE_MASK_uint, PaletteCount - 1);
+
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+		gl_state.use_program(tile_program->program);
+		gl_state.bind_vertex_array(data_stream< Config >->sprite_buffer_for_tile_program);
+	}
 
-	//return state to default:
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	//draw sprites with priority == 0 ('in front' sprites):
+	glUniform1ui(tile_program->PRIORITY_uint, 0x00);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(sprite_count));
 
-	glBindVertexArray(0);
-	glUseProgram(0);
+	//nothing else reads this frame's sprite records, so that part of the ring can be reused once the GPU is done:
+	data_stream< Config >->sprite_ring.fence();
 
-	glDisable(GL_BLEND);
+	//textures, program, vertex array, and blending are left as they are:
+	// gl_state tracks them, so the next draw only issues the calls that change something.
+
+	if (draw_offscreen) {
+		//scale the finished image up to the drawable with one blit:
+		gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, data_stream< Config >->offscreen_framebuffer);
+		gl_state.bind_framebuffer(GL_DRAW_FRAMEBUFFER, old_draw_framebuffer);
+		glBlitFramebuffer(
+			0, 0, ScreenWidth, ScreenHeight,
+			lower_left.x, lower_left.y, lower_left.x + size.x, lower_left.y + size.y,
+			GL_COLOR_BUFFER_BIT, GL_NEAREST
+		);
+		gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, old_read_framebuffer);
+		data_stream< Config >->offscreen_valid = true;
+	}
 
 	//also restore viewport, since earlier scaling code messed with it:
-	glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
+	gl_state.viewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
 
 	GL_ERRORS();
 }
@@ -298,15 +526,31 @@ PPUTileProgram::PPUTileProgram() {
 		//vertex shader:
 		"#version 330\n"
 		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"in vec4 Position;\n"
-		"in ivec2 TileCoord;\n"
-		"in int Palette;\n"
+		"uniform uint PRIORITY;\n" //only draw sprites whose priority bit matches
+		"uniform uint TILE_MASK;\n"
+		"uniform uint PALETTE_MASK;\n"
+		"in uvec4 Sprite;\n" //x, y, index, attributes
 		"out vec2 tileCoord;\n"
 		"flat out int palette;\n"
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	tileCoord = TileCoord;\n"
-		"	palette = Palette;\n"
+		//vertices 0-3 are the corners (0,0), (8,0), (0,8), (8,8) of a triangle strip:
+		"	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 8.0;\n"
+		"	if ((Sprite.w & 0x80u) != PRIORITY) {\n"
+		//sprite isn't drawn in this pass, so put all four vertices at the same spot outside the clip volume:
+		"		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+		"		tileCoord = vec2(0.0);\n"
+		"		palette = 0;\n"
+		"		return;\n"
+		"	}\n"
+		"	gl_Position = OBJECT_TO_CLIP * vec4(vec2(Sprite.xy) + corner, 0.0, 1.0);\n"
+		//attribute bits 3-4 are tile index bits 8-9:
+		"	uint tile = (Sprite.z | ((Sprite.w & 0x18u) << 5)) & TILE_MASK;\n"
+		//attribute bits 6 and 5 mirror the tile horizontally and vertically:
+		"	vec2 texCorner = corner;\n"
+		"	if ((Sprite.w & 0x40u) != 0u) texCorner.x = 8.0 - texCorner.x;\n"
+		"	if ((Sprite.w & 0x20u) != 0u) texCorner.y = 8.0 - texCorner.y;\n"
+		"	tileCoord = vec2(tile % 16u, tile / 16u) * 8.0 + texCorner;\n"
+		"	palette = int(Sprite.w & PALETTE_MASK);\n"
 		"}\n"
 	,
 		//fragment shader:
@@ -326,21 +570,22 @@ PPUTileProgram::PPUTileProgram() {
 	);
 
 	//look up the locations of vertex attributes:
-	Position_vec2 = glGetAttribLocation(program, "Position");
-	TileCoord_ivec2 = glGetAttribLocation(program, "TileCoord");
-	Palette_int = glGetAttribLocation(program, "Palette");
+	Sprite_uvec4 = glGetAttribLocation(program, "Sprite");
 
 	//look up the locations of uniforms:
 	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
+	PRIORITY_uint = glGetUniformLocation(program, "PRIORITY");
+	TILE_MASK_uint = glGetUniformLocation(program, "TILE_MASK");
+	PALETTE_MASK_uint = glGetUniformLocation(program, "PALETTE_MASK");
 
 	GLuint TILE_TABLE_usampler2D = glGetUniformLocation(program, "TILE_TABLE");
 	GLuint PALETTE_TABLE_sampler2D = glGetUniformLocation(program, "PALETTE_TABLE");
 
 	//bind texture units indices to samplers:
-	glUseProgram(program);
+	gl_state.use_program(program);
 	glUniform1i(TILE_TABLE_usampler2D, 0);
 	glUniform1i(PALETTE_TABLE_sampler2D, 1);
-	glUseProgram(0);
+	gl_state.use_program(0);
 
 	GL_ERRORS();
 }
@@ -350,97 +595,281 @@ PPUTileProgram::~PPUTileProgram() {
 		glDeleteProgram(program);
 		program = 0;
 	}
+	//deleted objects are no longer bound:
+	gl_state.forget();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PPUBackgroundProgram::PPUBackgroundProgram() {
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"uniform ivec2 SCREEN_SIZE;\n"
+		"out vec2 screenCoord;\n"
+		"void main() {\n"
+		//vertices 0-3 are the corners (0,0), (1,0), (0,1), (1,1) of a triangle strip:
+		"	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+		"	gl_Position = vec4(2.0 * corner - 1.0, 0.0, 1.0);\n"
+		"	screenCoord = corner * vec2(SCREEN_SIZE);\n"
+		"}\n"
+	,
+		//fragment shader:
+		"#version 330\n"
+		"uniform usampler2D TILE_TABLE;\n"
+		"uniform sampler2D PALETTE_TABLE;\n"
+		"uniform usampler2D BACKGROUND;\n"
+		"uniform ivec2 BACKGROUND_POSITION;\n" //already reduced to [0, background size in pixels)
+		"uniform uint TILE_MASK;\n"
+		"uniform uint PALETTE_MASK;\n"
+		"in vec2 screenCoord;\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		"	ivec2 size = textureSize(BACKGROUND, 0) * 8;\n"
+		//pixel within the background; adding 'size' keeps the operands of '%' positive:
+		"	ivec2 px = (ivec2(floor(screenCoord)) - BACKGROUND_POSITION + size) % size;\n"
+		"	uint info = texelFetch(BACKGROUND, px / 8, 0).r;\n"
+		//bits 11-12 are tile index bits 8-9:
+		"	int tile = int(((info & 0xffu) | ((info >> 3) & 0x300u)) & TILE_MASK);\n"
+		"	int palette = int((info >> 8) & PALETTE_MASK);\n"
+		//bits 14 and 13 mirror the tile horizontally and vertically:
+		"	ivec2 inTile = px % 8;\n"
+		"	if ((info & 0x4000u) != 0u) inTile.x = 7 - inTile.x;\n"
+		"	if ((info & 0x2000u) != 0u) inTile.y = 7 - inTile.y;\n"
+		"	ivec2 tileCoord = ivec2((tile % 16) * 8, (tile / 16) * 8) + inTile;\n"
+		"	uint index = texelFetch(TILE_TABLE, tileCoord, 0).r;\n"
+		"	fragColor = texelFetch(PALETTE_TABLE, ivec2(index, palette), 0);\n"
+		"}\n"
+	);
+
+	//look up the locations of uniforms:
+	SCREEN_SIZE_ivec2 = glGetUniformLocation(program, "SCREEN_SIZE");
+	BACKGROUND_POSITION_ivec2 = glGetUniformLocation(program, "BACKGROUND_POSITION");
+	TILE_MASK_uint = glGetUniformLocation(program, "TILE_MASK");
+	PALETTE_MASK_uint = glGetUniformLocation(program, "PALETTE_MASK");
+
+	GLuint TILE_TABLE_usampler2D = glGetUniformLocation(program, "TILE_TABLE");
+	GLuint PALETTE_TABLE_sampler2D = glGetUniformLocation(program, "PALETTE_TABLE");
+	GLuint BACKGROUND_usampler2D = glGetUniformLocation(program, "BACKGROUND");
+
+	//bind texture units indices to samplers:
+	gl_state.use_program(program);
+	glUniform1i(TILE_TABLE_usampler2D, 0);
+	glUniform1i(PALETTE_TABLE_sampler2D, 1);
+	glUniform1i(BACKGROUND_usampler2D, 2);
+	gl_state.use_program(0);
+
+	GL_ERRORS();
+}
+
+PPUBackgroundProgram::~PPUBackgroundProgram() {
+	if (program != 0) {
+		glDeleteProgram(program);
+		program = 0;
+	}
+	//deleted objects are no longer bound:
+	gl_state.forget();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PPUStreamRing::PPUStreamRing() {
+	glGenBuffers(1, &buffer);
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, buffer);
+	//allocate the whole ring once; it is never re-specified (which is what would force the driver to orphan it):
+	glBufferData(GL_ARRAY_BUFFER, Size, nullptr, GL_STREAM_DRAW);
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	GL_ERRORS();
+}
+
+PPUStreamRing::~PPUStreamRing() {
+	for (auto &f : in_flight) {
+		glDeleteSync(f.fence);
+	}
+	in_flight.clear();
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+	//deleted objects are no longer bound:
+	gl_state.forget();
+}
+
+GLintptr PPUStreamRing::write(void const *data, GLsizeiptr size) {
+	assert(size > 0 && size <= GLsizeiptr(Size) && "streamed data must fit in the ring");
+
+	//keep writes 16-byte aligned so they are suitable as attribute offsets:
+	GLintptr begin = (head + 15) & ~GLintptr(15);
+	if (begin + size > GLintptr(Size)) {
+		//not enough room before the end of the buffer, so wrap around:
+		// (unfenced data can't wrap, since it is expected to be one contiguous range)
+		assert(unfenced_begin == head && "fence() must be called before the ring wraps");
+		begin = 0;
+		unfenced_begin = 0;
+	}
+	GLintptr end = begin + size;
+
+	//does [begin,end) overlap a range the GPU might still be reading?
+	auto overlaps = [begin,end](InFlight const &f) {
+		if (f.begin <= f.end) return f.begin < end && begin < f.end;
+		else return f.begin < end || begin < f.end; //range wraps around the end of the buffer
+	};
+
+	//fences signal in order, so waiting for the newest overlapping range also retires everything older:
+	size_t retire = 0;
+	for (size_t i = 0; i < in_flight.size(); ++i) {
+		if (overlaps(in_flight[i])) retire = i + 1;
+	}
+	if (retire > 0) {
+		GLsync fence = in_flight[retire - 1].fence;
+		while (true) {
+			GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL /* 1s, in nanoseconds */);
+			if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) break;
+			if (result == GL_WAIT_FAILED) {
+				std::cerr << "WARNING: waiting on stream fence failed; stream data may be overwritten while in use." << std::endl;
+				break;
+			}
+		}
+	}
+	//also retire any older ranges whose fences have already signaled (without waiting):
+	while (retire < in_flight.size()) {
+		GLenum result = glClientWaitSync(in_flight[retire].fence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) break;
+		retire += 1;
+	}
+	for (size_t i = 0; i < retire; ++i) {
+		glDeleteSync(in_flight.front().fence);
+		in_flight.pop_front();
+	}
+
+	//copy data into the ring:
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, buffer);
+	void *ptr = glMapBufferRange(GL_ARRAY_BUFFER, begin, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (ptr) {
+		std::memcpy(ptr, data, size);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	} else {
+		//mapping can fail (e.g., on some debugging layers); the range is known to be free, so a plain upload is also fine:
+		glBufferSubData(GL_ARRAY_BUFFER, begin, size, data);
+	}
+
+	head = end;
+	return begin;
+}
+
+void PPUStreamRing::fence() {
+	if (unfenced_begin == head) return; //nothing written since last fence
+	InFlight f;
+	f.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	f.begin = unfenced_begin;
+	f.end = head;
+	in_flight.emplace_back(f);
+	unfenced_begin = head;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 
 //PPU data is streamed to the GPU (read: uploaded 'just in time') using a few buffers:
-PPUDataStream::PPUDataStream() {
-
-	//vertex_buffer_for_tile_program is a vertex array object that tells the GPU the layout of data in vertex_buffer:
-	glGenVertexArrays(1, &vertex_buffer_for_tile_program);
-	glBindVertexArray(vertex_buffer_for_tile_program);
-
-	//vertex_buffer will (eventually) hold vertex data for drawing:
-	glGenBuffers(1, &vertex_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-
-	//Notice how this binding is attaching an integer input to a floating point attribute:
-	glVertexAttribPointer(
-		tile_program->Position_vec2, //attribute
-		2, //size
-		GL_INT, //type
-		GL_FALSE, //normalized
-		sizeof(Vertex), //stride
-		(GLbyte *)0 + offsetof(Vertex, Position) //offset
-	);
-	glEnableVertexAttribArray(tile_program->Position_vec2);
+template< typename Config >
+PPUDataStream< Config >::PPUDataStream() {
 
-	//the "I" variant binds to an integer attribute:
-	glVertexAttribIPointer(
-		tile_program->TileCoord_ivec2, //attribute
-		2, //size
-		GL_INT, //type
-		sizeof(Vertex), //stride
-		(GLbyte *)0 + offsetof(Vertex, TileCoord) //offset
-	);
-	glEnableVertexAttribArray(tile_program->TileCoord_ivec2);
+	//sprite_buffer_for_tile_program is a vertex array object that tells the GPU the layout of data in sprite_ring.buffer:
+	glGenVertexArrays(1, &sprite_buffer_for_tile_program);
+	gl_state.bind_vertex_array(sprite_buffer_for_tile_program);
+
+	//sprite_ring's buffer will (eventually) hold copies of BasicPPU::sprites:
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, sprite_ring.buffer);
 
-	//I could have stored the Palette as another entry in the TileCoord attribute stream
+	//the "I" variant binds to an integer attribute; each sprite's four bytes become one uvec4:
+	// (the offset is updated every draw to point at the latest copy)
 	glVertexAttribIPointer(
-		tile_program->Palette_int, //attribute
-		1, //size
-		GL_UNSIGNED_INT, //type
-		sizeof(Vertex), //stride
-		(GLbyte *)0 + offsetof(Vertex, Palette) //offset
+		tile_program->Sprite_uvec4, //attribute
+		4, //size
+		GL_UNSIGNED_BYTE, //type
+		sizeof(PPUTypes::Sprite), //stride
+		(GLbyte *)0 + 0 //offset
 	);
-	glEnableVertexAttribArray(tile_program->Palette_int);
+	glEnableVertexAttribArray(tile_program->Sprite_uvec4);
+	//advance to the next sprite once per instance (rather than once per vertex):
+	glVertexAttribDivisor(tile_program->Sprite_uvec4, 1);
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, 0);
 
-	glBindVertexArray(0);
+	gl_state.bind_vertex_array(0);
 
 
 	glGenTextures(1, &tile_tex);
-	glBindTexture(GL_TEXTURE_2D, tile_tex);
+	gl_state.bind_texture(GL_TEXTURE_2D, tile_tex);
 	//passing 'nullptr' to TexImage says "allocate memory but don't store anything there":
 	// (textures will be uploaded later)
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 128, 128, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, TileTextureWidth, TileTextureHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
 	//make the texture have sharp pixels when magnified:
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	//when access past the edge, clamp to the edge:
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_state.bind_texture(GL_TEXTURE_2D, 0);
 
 
 	glGenTextures(1, &palette_tex);
-	glBindTexture(GL_TEXTURE_2D, palette_tex);
+	gl_state.bind_texture(GL_TEXTURE_2D, palette_tex);
 	//passing 'nullptr' to TexImage says "allocate memory but don't store anything there":
 	// (textures will be uploaded later)
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 4, 8, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 4, PPU::PaletteCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 	//make the texture have sharp pixels when magnified:
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	//when access past the edge, clamp to the edge:
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	gl_state.bind_texture(GL_TEXTURE_2D, 0);
+
+
+	glGenTextures(1, &background_tex);
+	gl_state.bind_texture(GL_TEXTURE_2D, background_tex);
+	//one 16-bit texel per background entry; uploaded (when it changes) during draw:
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, PPU::BackgroundWidth, PPU::BackgroundHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gl_state.bind_texture(GL_TEXTURE_2D, 0);
+
+
+	//the background quad's vertices are computed in the shader, but drawing still needs a vertex array object:
+	glGenVertexArrays(1, &empty_vertex_array);
+
+
+	glGenTextures(1, &offscreen_color_tex);
+	gl_state.bind_texture(GL_TEXTURE_2D, offscreen_color_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, PPU::ScreenWidth, PPU::ScreenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	gl_state.bind_texture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &offscreen_framebuffer);
+	gl_state.bind_framebuffer(GL_FRAMEBUFFER, offscreen_framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, offscreen_color_tex, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	gl_state.bind_framebuffer(GL_FRAMEBUFFER, 0);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		throw std::runtime_error("PPU offscreen framebuffer is incomplete (status " + std::to_string(status) + ").");
+	}
 
 
 	GL_ERRORS();
 }
 
-PPUDataStream::~PPUDataStream() {
-	if (vertex_buffer_for_tile_program != 0) {
-		glDeleteVertexArrays(1, &vertex_buffer_for_tile_program);
-		vertex_buffer_for_tile_program = 0;
-	}
-	if (vertex_buffer != 0) {
-		glDeleteBuffers(1, &vertex_buffer);
-		vertex_buffer = 0;
+template< typename Config >
+PPUDataStream< Config >::~PPUDataStream() {
+	if (sprite_buffer_for_tile_program != 0) {
+		glDeleteVertexArrays(1, &sprite_buffer_for_tile_program);
+		sprite_buffer_for_tile_program = 0;
 	}
 	if (tile_tex != 0) {
 		glDeleteTextures(1, &tile_tex);
@@ -450,4 +879,29 @@ PPUDataStream::~PPUDataStream() {
 		glDeleteTextures(1, &palette_tex);
 		palette_tex = 0;
 	}
+	if (background_tex != 0) {
+		glDeleteTextures(1, &background_tex);
+		background_tex = 0;
+	}
+	if (empty_vertex_array != 0) {
+		glDeleteVertexArrays(1, &empty_vertex_array);
+		empty_vertex_array = 0;
+	}
+	if (offscreen_framebuffer != 0) {
+		glDeleteFramebuffers(1, &offscreen_framebuffer);
+		offscreen_framebuffer = 0;
+	}
+	if (offscreen_color_tex != 0) {
+		glDeleteTextures(1, &offscreen_color_tex);
+		offscreen_color_tex = 0;
+	}
+	//deleted objects are no longer bound:
+	gl_state.forget();
 }
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+//compile the PPU configurations declared in PPU466.hpp:
+// (draw_software is instantiated in PPU466_software.cpp)
+template struct BasicPPU< PPU466Config >;
+template struct BasicPPU< PPU466DenseConfig >;
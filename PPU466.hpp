@@ -3,40 +3,51 @@
 /*
  * PPU466 -- a very limited graphics system [loosely] based on the NES's PPU.
  * 
+ * The PPU's dimensions (screen size, background size, and number of tiles, palettes, and sprites)
+ * are compile-time parameters of BasicPPU< Config >; PPU466 is the standard configuration.
  *
  */
 
 #include <glm/glm.hpp>
 #include <array>
 
-struct PPU466 {
-	PPU466();
-
-	//--------------------------------------------------------------
-	//Call these functions to draw with the PPU:
-
-	//when you wish the PPU to draw, tell it so:
-	// pass the size of the current framebuffer in pixels so it knows how to scale itself
-	void draw(glm::uvec2 const &drawable_size) const;
-
-	//for debugging, you can ask the PPU to draw its current tiles, palettes, etc:
-	// pass the size of the current framebuffer in pixels so it knows how to scale itself
-	//someday, maybe: void draw_DEBUG_overlay(glm::uvec2 drawable_size) const;
+//The standard PPU466 configuration:
+struct PPU466Config {
+	//screen size in pixels:
+	static constexpr uint32_t ScreenWidth = 256;
+	static constexpr uint32_t ScreenHeight = 240;
+	//background size in tiles:
+	static constexpr uint32_t BackgroundWidth = 64;
+	static constexpr uint32_t BackgroundHeight = 60;
+	//entries in the tile table, palette table, and sprite list:
+	static constexpr uint32_t TileCount = 256;
+	static constexpr uint32_t PaletteCount = 8;
+	static constexpr uint32_t SpriteCount = 64;
+	//entries in the metasprite list, and how many sprites (in total) metasprites may expand to:
+	static constexpr uint32_t MetaspriteCount = 16;
+	static constexpr uint32_t MetaspriteTileCount = 64;
+};
 
-	//--------------------------------------------------------------
-	//Set the values below to control the PPU's drawing:
+//A denser configuration for games that need more sprites and tiles:
+struct PPU466DenseConfig : PPU466Config {
+	static constexpr uint32_t TileCount = 512;
+	static constexpr uint32_t SpriteCount = 128;
+};
 
-	//The PPU's screen is 256x240:
-	// the origin -- pixel (0,0) -- is in the lower left
-	enum : uint32_t {
-		ScreenWidth = 256,
-		ScreenHeight = 240
+//Types shared by every PPU configuration:
+// (so, e.g., tiles loaded by the asset pipeline can be used by any PPU)
+struct PPUTypes {
+	//draw() only sends palettes, tiles, and background rows to the GPU when they have changed since the last draw.
+	//For profiling, these counters (shared by all PPUs, never reset) track what was actually sent:
+	struct UploadCounters {
+		uint64_t palette_uploads = 0; //glTexSubImage2D calls that updated palettes
+		uint64_t palettes = 0; //palettes uploaded
+		uint64_t tile_uploads = 0; //glTexSubImage2D calls that updated tiles
+		uint64_t tiles = 0; //tiles uploaded
+		uint64_t background_uploads = 0; //glTexSubImage2D calls that updated the background
+		uint64_t background_rows = 0; //background rows uploaded
 	};
-
-	//Background Color:
-	// The PPU clears the screen to the background color before other drawing takes place:
-	// the screen is cleared to this color before any other drawing takes place
-	glm::u8vec3 background_color = glm::u8vec3(0x00, 0x00, 0x00);
+	static UploadCounters upload_counters;
 
 	//Palette:
 	// The PPU uses 4-bit indexed color.
@@ -46,9 +57,6 @@ struct PPU466 {
 	//   color 0 to fully transparent
 	//   and color 1-3 to fully opaque.
 	static_assert(sizeof(Palette) == 16, "Palette is packed");
-	//Palette Table:
-	// The PPU stores 8 palettes for use when drawing tiles:
-	std::array< Palette, 8 > palette_table;
 
 	//Tile:
 	// The PPU uses 8x8 4-bit indexed-color tiles:
@@ -67,41 +75,6 @@ struct PPU466 {
 	};
 	static_assert(sizeof(Tile) == 16, "Tile is packed");
 
-	//Tile Table:
-	// The PPU has a 256-tile 'pattern memory' in which tiles are stored:
-	//  this is often thought of as a 16x16 grid of tiles.
-	std::array< Tile, 16 * 16 > tile_table;
-
-	//Background Layer:
-	// The PPU's background layer is made of 64x60 tiles (512 x 480 pixels):
-	enum : uint32_t {
-		BackgroundWidth = 64,
-		BackgroundHeight = 60
-	};
-
-	// The background is stored as a row-major grid of 16-bit values:
-	//  the origin of the grid (tile (0,0)) is the bottom left of the grid
-	//  each value in the grid gives:
-	//    - bits 0-7: tile table index
-	//    - bits 8-10: palette table index
-	//    - bits 11-15: unused, should be 0
-	//
-	//  bits:  F E D C B A 9 8 7 6 5 4 3 2 1 0
-	//        |---------|-----|---------------|
-	//            ^        ^        ^-- tile index
-	//            |        '----------- palette index
-	//            '-------------------- unused (set to zero)
-	std::array< uint16_t, BackgroundWidth * BackgroundHeight > background;
-
-	//Background Position:
-	// The background's lower-left pixel can positioned anywhere
-	//   this can be used to "scroll the screen".
-	glm::ivec2 background_position = glm::ivec2(0,0);
-	//
-	// screen pixels "outside the background" wrap around to the other side.
-	// thus, background_position values of (x,y) and of (x+n*512,y+m*480) for
-	// any integers n,m will look the same
-
 	//Sprite:
 	// On the PPU, all non-background objects are called 'sprites':
 	//
@@ -113,16 +86,20 @@ struct PPU466 {
 	//
 	//  the sprite 'attributes' byte gives:
 	//   bits:  7 6 5 4 3 2 1 0
-	//         |-|-------|-----|
-	//          ^    ^      ^
-	//          |    |      '---- palette index (bits 0-2)
-	//          |    '----------- unused (set to zero)
+	//         |-|-|-|---|-----|
+	//          ^ ^ ^  ^    ^
+	//          | | |  |    '---- palette index (bits 0-2)
+	//          | | |  '--------- tile index bits 8-9 (only used by PPUs with more than 256 tiles)
+	//          | | '------------ flip the tile vertically (bit 5)
+	//          | '-------------- flip the tile horizontally (bit 6)
 	//          '---------------- priority bit (bit 7)
 	//
 	//  the 'priority bit' chooses whether to render the sprite
 	//   in front of (priority = 0) the background
 	//   or behind (priority = 1) the background
 	//
+	//  the flip bits let one tile be drawn mirrored (e.g., a character facing the other way)
+	//
 	struct Sprite {
 		uint8_t x = 0; //x position. 0 is the left edge of the screen.
 		uint8_t y = 240; //y position. 0 is the bottom edge of the screen. >= 240 is off-screen
@@ -130,17 +107,202 @@ struct PPU466 {
 		uint8_t attributes = 0; //tile attribute bits
 	};
 	static_assert(sizeof(Sprite) == 4, "Sprite is a 32-bit value.");
+
+	//Flip bits, as they appear in sprite attributes:
+	// (background entries use the same bits shifted up by 8)
+	enum : uint8_t {
+		FlipX = 0x40, //mirror left-to-right
+		FlipY = 0x20, //mirror bottom-to-top
+		FlipMask = FlipX | FlipY
+	};
 	//
 	// The observant among you will notice that you can't draw a sprite moving off the left
 	//  or bottom edges of the screen. Yep! This is [similar to] a limitation of the NES PPU!
 
+	//Metasprite:
+	// A metasprite is a multi-tile object (e.g., a character) drawn as a grid of sprites:
+	//
+	//  (x,y) places the bottom-left of the grid, just like a sprite's position
+	//  width and height are in pixels (multiples of 8), as in AssetInfo
+	//  tile_indices lists (width/8)*(height/8) tile indices, row-by-row starting at the lower left
+	//   (this is the layout of AssetInfo::tile_indices, so an asset's list can be used directly)
+	//  the attributes byte applies to every tile, and means the same thing as a sprite's
+	//  tile_flips, if set, lists flip bits (FlipX, FlipY) for each tile that are combined with attributes
+	//   (this is the layout of AssetInfo::tile_flips, for tiles the converter stored as mirrors of other tiles)
+	//
+	struct Metasprite {
+		uint8_t x = 0; //x position of the bottom-left tile.
+		uint8_t y = 240; //y position of the bottom-left tile. >= 240 is off-screen
+		uint8_t width = 0; //width in pixels
+		uint8_t height = 0; //height in pixels
+		uint8_t const *tile_indices = nullptr; //not owned; must stay valid until the PPU draws
+		uint8_t attributes = 0; //attribute bits for every tile
+		uint8_t const *tile_flips = nullptr; //optional, not owned; same length as tile_indices
+		//number of sprites this metasprite expands to (if it is entirely on-screen):
+		uint32_t tile_count() const { return (uint32_t(width) / 8) * (uint32_t(height) / 8); }
+	};
+	//
+	// Tiles of a metasprite that land past the right or top edge of the screen are skipped
+	//  (rather than wrapping around, as a sprite's 8-bit position would).
+};
+
+template< typename Config >
+struct BasicPPU : PPUTypes {
+	BasicPPU();
+
+	//--------------------------------------------------------------
+	//Call these functions to draw with the PPU:
+
+	//when you wish the PPU to draw, tell it so:
+	// pass the size of the current framebuffer in pixels so it knows how to scale itself
+	void draw(glm::uvec2 const &drawable_size) const;
+
+	//for debugging, you can ask the PPU to draw its current tiles, palettes, etc:
+	// pass the size of the current framebuffer in pixels so it knows how to scale itself
+	//someday, maybe: void draw_DEBUG_overlay(glm::uvec2 drawable_size) const;
+
+	//--------------------------------------------------------------
+	//Set the values below to control the PPU's drawing:
+
+	//The PPU's screen is 256x240 (by default):
+	// the origin -- pixel (0,0) -- is in the lower left
+	enum : uint32_t {
+		ScreenWidth = Config::ScreenWidth,
+		ScreenHeight = Config::ScreenHeight
+	};
+	//(sprite positions are 8 bits, and the default sprite y of 240 must be off-screen)
+	static_assert(ScreenWidth <= 256 && ScreenHeight <= 240, "Sprites must be able to reach every pixel of the screen.");
+
+	//Software rendering:
+	// draw_software() produces the same image as draw() does at 1x scale, but on the CPU,
+	// so it works without an OpenGL context (e.g., for headless runs or comparing against saved images).
+	// the framebuffer is stored row-major, with the bottom row first (matching LowerLeftOrigin in load_save_png.hpp):
+	typedef std::array< glm::u8vec4, ScreenWidth * ScreenHeight > Framebuffer;
+	void draw_software(Framebuffer *framebuffer) const;
+
+	//Headless mode:
+	// when 'headless_framebuffer' is set, draw() ignores drawable_size and uses draw_software() to draw into it.
+	// (this lets unmodified Mode code run without a window or OpenGL context)
+	static Framebuffer *headless_framebuffer;
+
+	//Offscreen rendering:
+	// when 'draw_offscreen' is set, draw() renders at native resolution (ScreenWidth x ScreenHeight)
+	// into an offscreen framebuffer, then scales it to the drawable with a single glBlitFramebuffer,
+	// so the number of pixels shaded doesn't grow with the window size.
+	bool draw_offscreen = false;
+
+	//copy the last frame drawn with draw_offscreen set into 'framebuffer' (at native resolution):
+	// returns false (and leaves 'framebuffer' alone) if no frame has been drawn that way yet
+	// (in headless mode, this copies headless_framebuffer instead)
+	bool read_offscreen(Framebuffer *framebuffer) const;
+
+	//Background Color:
+	// The PPU clears the screen to the background color before other drawing takes place:
+	// the screen is cleared to this color before any other drawing takes place
+	glm::u8vec3 background_color = glm::u8vec3(0x00, 0x00, 0x00);
+
+	//Palette Table:
+	// The PPU stores 8 palettes (by default) for use when drawing tiles:
+	enum : uint32_t { PaletteCount = Config::PaletteCount };
+	static_assert(PaletteCount >= 1 && PaletteCount <= 8 && (PaletteCount & (PaletteCount - 1)) == 0, "Palette index must fit in three bits.");
+	std::array< Palette, PaletteCount > palette_table;
+
+	//Tile Table:
+	// The PPU has a 256-tile (by default) 'pattern memory' in which tiles are stored:
+	//  this is often thought of as a grid of tiles, 16 tiles wide.
+	enum : uint32_t { TileCount = Config::TileCount };
+	static_assert(TileCount >= 16 && TileCount <= 1024 && (TileCount & (TileCount - 1)) == 0, "Tile index must fit in ten bits.");
+	std::array< Tile, TileCount > tile_table;
+
+	//Background Layer:
+	// The PPU's background layer is made of 64x60 tiles (512 x 480 pixels) by default:
+	enum : uint32_t {
+		BackgroundWidth = Config::BackgroundWidth,
+		BackgroundHeight = Config::BackgroundHeight
+	};
+
+	// The background is stored as a row-major grid of 16-bit values:
+	//  the origin of the grid (tile (0,0)) is the bottom left of the grid
+	//  each value in the grid gives:
+	//    - bits 0-7: tile table index
+	//    - bits 8-10: palette table index
+	//    - bits 11-12: tile table index bits 8-9 (only used by PPUs with more than 256 tiles)
+	//    - bit 13: flip the tile vertically (FlipY << 8)
+	//    - bit 14: flip the tile horizontally (FlipX << 8)
+	//    - bit 15: unused, should be 0
+	//
+	//  bits:  F E D C B A 9 8 7 6 5 4 3 2 1 0
+	//        |-|-|-|---|-----|---------------|
+	//         ^ ^ ^  ^    ^        ^-- tile index
+	//         | | |  |    '----------- palette index
+	//         | | |  '---------------- tile index bits 8-9
+	//         | | '------------------- flip vertically
+	//         | '--------------------- flip horizontally
+	//         '----------------------- unused (set to zero)
+	std::array< uint16_t, BackgroundWidth * BackgroundHeight > background;
+
+	//Background Position:
+	// The background's lower-left pixel can positioned anywhere
+	//   this can be used to "scroll the screen".
+	glm::ivec2 background_position = glm::ivec2(0,0);
+	//
+	// screen pixels "outside the background" wrap around to the other side.
+	// thus, background_position values of (x,y) and of (x+n*512,y+m*480) for
+	// any integers n,m will look the same
 
 	//Sprites:
-	// The PPU always draws exactly 64 sprites:
+	// The PPU always draws exactly 64 sprites (by default):
 	//  any sprites you don't want to use should be moved off the screen (y >= 240)
-	std::array< Sprite, 64 > sprites;
+	enum : uint32_t { SpriteCount = Config::SpriteCount };
+	std::array< Sprite, SpriteCount > sprites;
+
+	//Metasprites:
+	// The PPU also draws up to 16 metasprites (by default), after -- so, on top of -- the sprites above:
+	//  unused metasprites should be moved off the screen (y >= 240) or have no tiles
+	// Together, metasprites can use 64 sprites' worth of tiles (by default); tiles past that are not drawn.
+	enum : uint32_t {
+		MetaspriteCount = Config::MetaspriteCount,
+		MetaspriteTileCount = Config::MetaspriteTileCount
+	};
+	std::array< Metasprite, MetaspriteCount > metasprites;
+
+	//The sprites actually drawn are 'sprites' followed by the tiles of each metasprite, in order.
+	//list_sprites() writes that list and returns its length:
+	// (both draw() and draw_software() use this)
+	typedef std::array< Sprite, SpriteCount + MetaspriteTileCount > SpriteList;
+	uint32_t list_sprites(SpriteList *list) const;
+
+	//--------------------------------------------------------------
+	//Helpers that decode the fields described above:
+
+	static constexpr uint32_t sprite_tile(Sprite const &sprite) {
+		return (uint32_t(sprite.index) | (uint32_t(sprite.attributes & 0x18) << 5)) & (TileCount - 1);
+	}
+	static constexpr uint32_t sprite_palette(Sprite const &sprite) {
+		return uint32_t(sprite.attributes) & (PaletteCount - 1);
+	}
+	static constexpr uint32_t sprite_flips(Sprite const &sprite) {
+		return uint32_t(sprite.attributes) & FlipMask;
+	}
+	static constexpr uint32_t background_tile(uint16_t info) {
+		return (uint32_t(info & 0xff) | (uint32_t(info >> 3) & 0x300)) & (TileCount - 1);
+	}
+	static constexpr uint32_t background_palette(uint16_t info) {
+		return uint32_t(info >> 8) & (PaletteCount - 1);
+	}
+	static constexpr uint32_t background_flips(uint16_t info) {
+		return uint32_t(info >> 8) & FlipMask;
+	}
 
 };
+
+typedef BasicPPU< PPU466Config > PPU466;
+typedef BasicPPU< PPU466DenseConfig > PPU466Dense;
+
+//both configurations are compiled once, in PPU466.cpp and PPU466_software.cpp:
+extern template struct BasicPPU< PPU466Config >;
+extern template struct BasicPPU< PPU466DenseConfig >;
+
 /*
 vector<Tile> tile;
 vector<Pallette> pal;
@@ -0,0 +1,136 @@
+#include "PPU466.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+//BasicPPU::draw_software rasterizes the PPU's state one scanline at a time.
+//Each scanline is built exactly like draw() builds the whole screen:
+// clear to background color, then 'behind' sprites, then background, then 'in front' sprites,
+// with each layer alpha-blended (as with glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)) over the last.
+
+namespace {
+
+//Tile rows are decoded eight pixels at a time:
+// SpreadBits[b] has bit i of 'b' moved to the low bit of byte i,
+// so (SpreadBits[bit0] | SpreadBits[bit1] << 1) holds all eight 2-bit color indices of a row, one per byte.
+struct SpreadTable {
+	constexpr SpreadTable() : spread() {
+		for (uint32_t b = 0; b < 256; ++b) {
+			uint64_t s = 0;
+			for (uint32_t i = 0; i < 8; ++i) {
+				s |= uint64_t((b >> i) & 1) << (8 * i);
+			}
+			spread[b] = s;
+		}
+	}
+	uint64_t spread[256];
+};
+constexpr SpreadTable SpreadBits;
+
+inline uint64_t decode_row(PPUTypes::Tile const &tile, uint32_t row) {
+	return SpreadBits.spread[tile.bit0[row]] | (SpreadBits.spread[tile.bit1[row]] << 1);
+}
+
+//decode_row for a tile drawn with flip bits (PPUTypes::FlipX, PPUTypes::FlipY):
+// (mirroring left-to-right reverses the bytes of the decoded row)
+inline uint64_t decode_row(PPUTypes::Tile const &tile, uint32_t row, uint32_t flips) {
+	if (flips & PPUTypes::FlipY) row = 7 - row;
+	uint64_t indices = decode_row(tile, row);
+	if (flips & PPUTypes::FlipX) {
+		indices = ((indices & 0x00ff00ff00ff00ffULL) << 8) | ((indices >> 8) & 0x00ff00ff00ff00ffULL);
+		indices = ((indices & 0x0000ffff0000ffffULL) << 16) | ((indices >> 16) & 0x0000ffff0000ffffULL);
+		indices = (indices << 32) | (indices >> 32);
+	}
+	return indices;
+}
+
+//blend 'src' over 'dst' with the same math as GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA:
+inline void blend(glm::u8vec4 &dst, glm::u8vec4 const &src) {
+	if (src.a == 0xff) {
+		dst = src;
+	} else if (src.a != 0x00) {
+		uint32_t a = src.a;
+		uint32_t ia = 0xff - a;
+		dst.r = uint8_t((src.r * a + dst.r * ia + 127) / 255);
+		dst.g = uint8_t((src.g * a + dst.g * ia + 127) / 255);
+		dst.b = uint8_t((src.b * a + dst.b * ia + 127) / 255);
+		dst.a = uint8_t((src.a * a + dst.a * ia + 127) / 255);
+	}
+}
+
+} //end anonymous namespace
+
+template< typename Config >
+void BasicPPU< Config >::draw_software(Framebuffer *framebuffer_) const {
+	assert(framebuffer_);
+	auto &framebuffer = *framebuffer_;
+
+	//this frame's sprites -- 'sprites' plus expanded metasprites:
+	SpriteList sprite_list;
+	const uint32_t sprite_count = list_sprites(&sprite_list);
+
+	const glm::u8vec4 clear_color = glm::u8vec4(background_color.r, background_color.g, background_color.b, 0xff);
+
+	constexpr int32_t BackgroundWidthPixels = int32_t(BackgroundWidth) * 8;
+	constexpr int32_t BackgroundHeightPixels = int32_t(BackgroundHeight) * 8;
+
+	//reduce background position to [0,BackgroundWidthPixels) x [0,BackgroundHeightPixels):
+	const glm::ivec2 position = glm::ivec2(
+		((background_position.x % BackgroundWidthPixels) + BackgroundWidthPixels) % BackgroundWidthPixels,
+		((background_position.y % BackgroundHeightPixels) + BackgroundHeightPixels) % BackgroundHeightPixels
+	);
+
+	for (uint32_t y = 0; y < ScreenHeight; ++y) {
+		glm::u8vec4 *line = &framebuffer[ScreenWidth * y];
+
+		std::fill(line, line + ScreenWidth, clear_color);
+
+		//helper to draw the part of each sprite that overlaps this scanline:
+		auto draw_sprites = [&](uint8_t priority) {
+			for (uint32_t s = 0; s < sprite_count; ++s) {
+				Sprite const &sprite = sprite_list[s];
+				if ((sprite.attributes & 0x80) != priority) continue;
+				if (y < sprite.y || y >= uint32_t(sprite.y) + 8) continue;
+
+				uint64_t indices = decode_row(tile_table[sprite_tile(sprite)], y - sprite.y, sprite_flips(sprite));
+				Palette const &palette = palette_table[sprite_palette(sprite)];
+
+				uint32_t end = std::min(uint32_t(sprite.x) + 8, uint32_t(ScreenWidth));
+				for (uint32_t x = sprite.x; x < end; ++x) {
+					blend(line[x], palette[indices & 0x3]);
+					indices >>= 8;
+				}
+			}
+		};
+
+		draw_sprites(0x80); //sprites with priority == 1 ('behind' sprites)
+
+		{ //background:
+			//pixel row within the background that lands on this scanline:
+			uint32_t by = uint32_t((int32_t(y) - position.y + BackgroundHeightPixels) % BackgroundHeightPixels);
+			uint16_t const *row = &background[BackgroundWidth * (by / 8)];
+
+			//walk across the screen one background tile at a time, starting part-way into the first tile:
+			uint32_t bx = uint32_t((BackgroundWidthPixels - position.x) % BackgroundWidthPixels);
+			uint32_t tx = bx / 8;
+			uint32_t skip = bx % 8;
+			for (uint32_t x = 0; x < ScreenWidth; tx = (tx + 1) % BackgroundWidth) {
+				uint16_t info = row[tx];
+				uint64_t indices = decode_row(tile_table[background_tile(info)], by % 8, background_flips(info)) >> (8 * skip);
+				Palette const &palette = palette_table[background_palette(info)];
+
+				uint32_t end = std::min(x + (8 - skip), uint32_t(ScreenWidth));
+				for (; x < end; ++x) {
+					blend(line[x], palette[indices & 0x3]);
+					indices >>= 8;
+				}
+				skip = 0;
+			}
+		}
+
+		draw_sprites(0x00); //sprites with priority == 0 ('in front' sprites)
+	}
+}
+
+template void BasicPPU< PPU466Config >::draw_software(Framebuffer *) const;
+template void BasicPPU< PPU466DenseConfig >::draw_software(Framebuffer *) const;
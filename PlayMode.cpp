@@ -1,35 +1,47 @@
 #include "PlayMode.hpp"
 //for the GL_ERRORS() macro:
 #include "gl_errors.hpp"
+#include "load_save_png.hpp"
 
 //for glm::value_ptr() :
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <iostream>
 #include <random>
 
 PlayMode::PlayMode() {
-	// read tiles
-	std::ifstream source_tile_file(data_path(Converter::TILE_CHUNK_FILE), std::ios::binary);
-	read_chunk(source_tile_file, Converter::TILE_MAGIC, &converted_tiles);
-	// read palettes
-	std::ifstream source_palette_file(data_path(Converter::PALETTE_CHUNK_FILE), std::ios::binary);
-	read_chunk(source_palette_file, Converter::PALETTE_MAGIC, &converted_palettes);
+	// map the asset bundle; tiles and palettes are viewed in place (or inflated, if compressed) and copied into the PPU tables
+	AssetBundle bundle(data_path(Converter::BUNDLE_FILE));
+	std::vector< PPU466::Tile > tile_storage;
+	ChunkView< PPU466::Tile > tiles = bundle.read_section(Converter::TILE_MAGIC, &tile_storage);
+	std::vector< PPU466::Palette > palette_storage;
+	ChunkView< PPU466::Palette > palettes = bundle.read_section(Converter::PALETTE_MAGIC, &palette_storage);
 	// read asset infos
-	std::ifstream source_asset_info_file(data_path(Converter::ASSET_INFO_CHUNK_FILE), std::ios::binary);
-	read_asset_info_chunk(source_asset_info_file, &asset_infos);
+	read_asset_infos(bundle, &asset_infos);
 
-	assert(converted_tiles.size() <= ppu.tile_table.size());
-	assert(converted_palettes.size() <= ppu.palette_table.size());
+	// render at native resolution and upscale once (also makes native-resolution screenshots cheap)
+	ppu.draw_offscreen = true;
 
-	for (uint32_t i = 0; i < converted_tiles.size(); i++) {
-		ppu.tile_table[i] = converted_tiles[i];
-	}
-	for (uint32_t i = 0; i < converted_palettes.size(); i++) {
-		ppu.palette_table[i] = converted_palettes[i];
-	}
+	assert(tiles.size <= ppu.tile_table.size());
+	assert(palettes.size <= ppu.palette_table.size());
+
+	std::copy(tiles.begin(), tiles.end(), ppu.tile_table.begin());
+	std::copy(palettes.begin(), palettes.end(), ppu.palette_table.begin());
 
 	player.size.x = asset_infos[player.asset_id].width;
 	player.size.y = asset_infos[player.asset_id].height;
 
+	// the spiked ball asset repeats all the way up the right edge of the screen
+	uint32_t n_spike_rows = asset_infos[spikedball_id].height / 8;
+	uint32_t n_spike_cols = asset_infos[spikedball_id].width / 8;
+	for (uint32_t i = 0; i < PPU466::ScreenHeight / 8; i++) {
+		for (uint32_t j = 0; j < n_spike_cols; j++) {
+			uint32_t t = n_spike_cols * (i % n_spike_rows) + j;
+			spike_column_tiles.push_back(asset_infos[spikedball_id].tile_indices[t]);
+			spike_column_flips.push_back(asset_infos[spikedball_id].tile_flip(t));
+		}
+	}
+
 
 	// randomly generate star positions
 	int x_cor_gap;
@@ -67,6 +79,19 @@ bool PlayMode::handle_event(SDL_Event const& evt, glm::uvec2 const& window_size)
 			down.pressed = true;
 			return true;
 		}*/
+		if (evt.key.keysym.sym == SDLK_F2) {
+			// save the last frame at the ppu's native resolution
+			static PPU466::Framebuffer framebuffer;
+			if (ppu.read_offscreen(&framebuffer)) {
+				for (auto &px : framebuffer) {
+					px.a = 0xff;
+				}
+				std::string filename = "screenshot_native.png";
+				std::cout << "Saving native-resolution screenshot to '" << filename << "'." << std::endl;
+				save_png(filename, glm::uvec2(PPU466::ScreenWidth, PPU466::ScreenHeight), framebuffer.data(), LowerLeftOrigin);
+			}
+			return true;
+		}
 		if (evt.key.keysym.sym == SDLK_SPACE && jump.is_jumping == false) {
 			jump.yspeed += UNIT_JUMP_SPEED;
 			if (jump.yspeed > MAX_JUMP_SPEED)
@@ -113,6 +138,10 @@ bool PlayMode::handle_event(SDL_Event const& evt, glm::uvec2 const& window_size)
 
 void PlayMode::update(float elapsed) {
 	static std::mt19937 mt;
+	previous_player_pos = player.pos;
+	previous_background_pos_x = background_pos_x;
+	previous_killer_y_position = killer_y_position;
+
 	//slowly rotates through [0,1):
 	// (will be used to set background color)
 	background_fade += elapsed / 10.0f;
@@ -237,8 +266,6 @@ void PlayMode::update(float elapsed) {
 
 	// background move left at a constant speed
 	background_pos_x -= scroll_distance;
-	ppu.background_position.x = (int) background_pos_x;
-	ppu.background_position.x %= (int)PPU466::ScreenWidth;
 
 	if (platforms.back().x + new_gap * 8 <= PPU466::ScreenWidth + 8) {
 		std::uniform_int_distribution<uint32_t> gap_rand(min_gap, max_gap);
@@ -259,9 +286,22 @@ void PlayMode::update(float elapsed) {
 	killer_y_position = killer_y_position > asset_infos[fire_id].height ? killer_y_position: asset_infos[fire_id].height;
 }
 
-void PlayMode::draw(glm::uvec2 const& drawable_size) {
+void PlayMode::draw(glm::uvec2 const& drawable_size, float alpha) {
 	//--- set ppu state based on game state ---
 
+	// blend from the previous update's state toward the current one
+	// (written so that alpha == 1 gives exactly the current value)
+	auto blend = [alpha](auto previous, auto current) {
+		return current + (previous - current) * (1.0f - alpha);
+	};
+	glm::vec2 player_pos = blend(previous_player_pos, player.pos);
+	double killer_y = blend(previous_killer_y_position, killer_y_position);
+	// scroll that hasn't happened yet at this alpha; platforms scroll with the background
+	float scroll_lag = float(blend(previous_background_pos_x, background_pos_x) - background_pos_x);
+
+	ppu.background_position.x = (int) (background_pos_x + scroll_lag);
+	ppu.background_position.x %= (int)PPU466::ScreenWidth;
+
 	//background color will be some hsv-like fade:
 	ppu.background_color = glm::u8vec4(
 		0, 0, 0,
@@ -269,14 +309,6 @@ void PlayMode::draw(glm::uvec2 const& drawable_size) {
 	);
 
 
-	// Initialize all sprites to be out of screen:
-	for (uint32_t i = 0; i < 64; ++i) {
-		ppu.sprites[i].x = 0;
-		ppu.sprites[i].y = 240;
-		ppu.sprites[i].index = asset_infos[transparent_id].tile_indices[0];
-		ppu.sprites[i].attributes = asset_infos[transparent_id].palette_index;
-	}
-
 	//player sprite:
 	if (dying) {
 		player.asset_id = player_dead_id;
@@ -291,35 +323,31 @@ void PlayMode::draw(glm::uvec2 const& drawable_size) {
 		player.asset_id = player_stand_id;
 	}
 
-	uint32_t n_player_rows = asset_infos[player.asset_id].height / 8;
-	uint32_t n_player_cols = asset_infos[player.asset_id].width / 8;
-	uint32_t player_offset = 0;
+	// every object is one metasprite, which the ppu expands into 8x8 sprites
+	uint32_t metasprite_count = 0;
+	auto add_metasprite = [&](int32_t x, int32_t y, uint32_t width, uint32_t height, uint8_t const *tile_indices, uint8_t const *tile_flips, uint8_t palette_index) {
+		assert(metasprite_count < ppu.metasprites.size());
+		PPU466::Metasprite &meta = ppu.metasprites[metasprite_count++];
+		meta.x = x;
+		meta.y = y;
+		meta.width = width;
+		meta.height = height;
+		meta.tile_indices = tile_indices;
+		meta.tile_flips = tile_flips;
+		meta.attributes = palette_index;
+	};
+	auto add_asset = [&](uint32_t asset_id, int32_t x, int32_t y) {
+		AssetInfo const &info = asset_infos[asset_id];
+		add_metasprite(x, y, info.width, info.height, info.tile_indices.data(),
+			info.tile_flips.empty() ? nullptr : info.tile_flips.data(), info.palette_index);
+	};
+
 	if (!dead) {
-		for (uint32_t i = 0; i < n_player_rows; i++) {
-			for (uint32_t j = 0; j < n_player_cols; j++) {
-				ppu.sprites[player_offset].x = int32_t(player.pos.x + j * 8);
-				ppu.sprites[player_offset].y = int32_t(player.pos.y + i * 8);
-				ppu.sprites[player_offset].index = asset_infos[player.asset_id].tile_indices[player_offset];
-				ppu.sprites[player_offset].attributes = asset_infos[player.asset_id].palette_index;
-                player_offset++;
-			}
-		}
+		add_asset(player.asset_id, int32_t(player_pos.x), int32_t(player_pos.y));
 	}
-	player_offset = asset_infos[player_stand_id].height * asset_infos[player_stand_id].width / 64;
+
 	// draw killer
-    uint32_t n_killer_rows = asset_infos[killer_id].height / 8;
-    uint32_t n_killer_cols = asset_infos[killer_id].width / 8;
-    uint32_t killer_offset = player_offset;
-    for (uint32_t i = 0; i < n_killer_rows; i++) {
-        for (uint32_t j = 0; j < n_killer_cols; j++) {
-            ppu.sprites[killer_offset].x = int32_t(0 + j * 8);
-            ppu.sprites[killer_offset].y = int32_t(killer_y_position + i * 8);
-            ppu.sprites[killer_offset].index = asset_infos[killer_id].tile_indices[killer_offset - player_offset];
-            ppu.sprites[killer_offset].attributes = asset_infos[killer_id].palette_index;
-            killer_offset++;
-        }
-    }
-	
+	add_asset(killer_id, 0, int32_t(killer_y));
 
 	//draw score
 	uint32_t display_score = (uint32_t)score > 999 ? 999 : (uint32_t)score;
@@ -327,62 +355,18 @@ void PlayMode::draw(glm::uvec2 const& drawable_size) {
 	uint8_t tens = ((display_score - units) / 10) % 10;
 	uint8_t hundreds = (display_score - units - tens * 10) / 100;
 
-	uint32_t score_offset = killer_offset;
-	// display units
-	ppu.sprites[score_offset].x = 3 * 8;
-	ppu.sprites[score_offset].y = PPU466::ScreenHeight - 2 * 8;
-	ppu.sprites[score_offset].index = asset_infos[score_0_id + units].tile_indices[0];
-	ppu.sprites[score_offset].attributes = asset_infos[score_0_id + units].palette_index;
-	score_offset++;
-
-	ppu.sprites[score_offset].x = ppu.sprites[score_offset - 1].x;
-	ppu.sprites[score_offset].y = ppu.sprites[score_offset - 1].y + 8;
-	ppu.sprites[score_offset].index = asset_infos[score_0_id + units].tile_indices[1];
-	ppu.sprites[score_offset].attributes = asset_infos[score_0_id + units].palette_index;
-	score_offset++;
-
-	// tens
-	ppu.sprites[score_offset].x = 2 * 8;
-	ppu.sprites[score_offset].y = PPU466::ScreenHeight - 2 * 8;
-	ppu.sprites[score_offset].index = asset_infos[score_0_id + tens].tile_indices[0];
-	ppu.sprites[score_offset].attributes = asset_infos[score_0_id + tens].palette_index;
-	score_offset++;
-
-	ppu.sprites[score_offset].x = ppu.sprites[score_offset - 1].x;
-	ppu.sprites[score_offset].y = ppu.sprites[score_offset - 1].y + 8;
-	ppu.sprites[score_offset].index = asset_infos[score_0_id + tens].tile_indices[1];
-	ppu.sprites[score_offset].attributes = asset_infos[score_0_id + tens].palette_index;
-	score_offset++;
-
-	// hundreds
-	ppu.sprites[score_offset].x = 1 * 8;
-	ppu.sprites[score_offset].y = PPU466::ScreenHeight - 2 * 8;
-	ppu.sprites[score_offset].index = asset_infos[score_0_id + hundreds].tile_indices[0];
-	ppu.sprites[score_offset].attributes = asset_infos[score_0_id + hundreds].palette_index;
-	score_offset++;
-
-	ppu.sprites[score_offset].x = ppu.sprites[score_offset - 1].x;
-	ppu.sprites[score_offset].y = ppu.sprites[score_offset - 1].y + 8;
-	ppu.sprites[score_offset].index = asset_infos[score_0_id + hundreds].tile_indices[1];
-	ppu.sprites[score_offset].attributes = asset_infos[score_0_id + hundreds].palette_index;
-	score_offset++;
-
-	// draw spiked ball
-	uint32_t n_spike_rows = asset_infos[spikedball_id].height / 8;
-	uint32_t n_spike_cols = asset_infos[spikedball_id].width / 8;
-	uint32_t spike_offset = score_offset;
-	for (uint32_t i = 0; i < PPU466::ScreenHeight / 8; i++) {
-		for (uint32_t j = 0; j < n_spike_cols; j++) {
-			ppu.sprites[spike_offset].x = int32_t(PPU466::ScreenWidth - (n_spike_cols - j) * 8);
-			ppu.sprites[spike_offset].y = int32_t(i * 8);
-			ppu.sprites[spike_offset].index = asset_infos[spikedball_id].tile_indices[n_spike_cols * (i % n_spike_rows) + j];
-			ppu.sprites[spike_offset].attributes = asset_infos[spikedball_id].palette_index;
-			spike_offset++;
-			if (spike_offset == ppu.sprites.size())
-				break;
-		}
-		if (spike_offset == ppu.sprites.size())
-			break;
+	add_asset(score_0_id + units, 3 * 8, PPU466::ScreenHeight - 2 * 8);
+	add_asset(score_0_id + tens, 2 * 8, PPU466::ScreenHeight - 2 * 8);
+	add_asset(score_0_id + hundreds, 1 * 8, PPU466::ScreenHeight - 2 * 8);
+
+	// draw spiked ball column along the right edge of the screen
+	add_metasprite(PPU466::ScreenWidth - asset_infos[spikedball_id].width, 0,
+		asset_infos[spikedball_id].width, PPU466::ScreenHeight,
+		spike_column_tiles.data(), spike_column_flips.data(), asset_infos[spikedball_id].palette_index);
+
+	// hide unused metasprites
+	for (uint32_t i = metasprite_count; i < ppu.metasprites.size(); i++) {
+		ppu.metasprites[i] = PPU466::Metasprite();
 	}
 
     /* Draw background of ppu */
@@ -394,16 +378,20 @@ void PlayMode::draw(glm::uvec2 const& drawable_size) {
 		}
 	}
 
+	// background entry for one tile of an asset (tile index, palette and flip bits)
+	auto background_entry = [&](uint32_t asset_id, size_t tile) {
+		AssetInfo const &info = asset_infos[asset_id];
+		return uint16_t(info.tile_indices[tile] | (info.palette_index << 8) | (info.tile_flip(tile) << 8));
+	};
+
 	// draw fire
 	int fire_flame = total_elapsed - (int)total_elapsed > 0.5 ? fire_id : fire_2_id;
 	for (uint32_t i = 0; i < PPU466::BackgroundWidth; i++) {
-		ppu.background[i] = asset_infos[fire_flame].tile_indices[0] |
-			(asset_infos[fire_flame].palette_index << 8);
+		ppu.background[i] = background_entry(fire_flame, 0);
 	}
 
 	for (uint32_t i = 0; i < PPU466::BackgroundWidth; i++) {
-		ppu.background[PPU466::BackgroundWidth + i] = asset_infos[fire_flame].tile_indices[1] |
-			(asset_infos[fire_flame].palette_index << 8);
+		ppu.background[PPU466::BackgroundWidth + i] = background_entry(fire_flame, 1);
 	}
 
 	// draw platforms
@@ -412,10 +400,10 @@ void PlayMode::draw(glm::uvec2 const& drawable_size) {
 		uint32_t ncols = platform.width / 8;
 		for (uint32_t i = 0; i < nrows; i++) {
 			for (uint32_t j = 0; j < ncols; j++) {
-				float idx = ((platform.x + j * 8 - ppu.background_position.x) / 8) + 1 + PPU466::BackgroundWidth * i;
+				float idx = ((platform.x + scroll_lag + j * 8 - ppu.background_position.x) / 8) + 1 + PPU466::BackgroundWidth * i;
 				if (idx < 0 || idx >= ppu.background.size())
 					continue;
-				ppu.background[(uint32_t) idx] = asset_infos[brick_id].tile_indices[0] | (asset_infos[brick_id].palette_index << 8);
+				ppu.background[(uint32_t) idx] = background_entry(brick_id, 0);
 			}
 		}
 	}
@@ -423,8 +411,7 @@ void PlayMode::draw(glm::uvec2 const& drawable_size) {
 	// draw star
     int star_shift = total_elapsed - (int)total_elapsed > 0.5 ? star_id : star_2_id;
     for(auto& star: stars_pos) {
-	    ppu.background[star[0] + star[1] * PPU466::BackgroundWidth] =
-	            asset_infos[star_shift].tile_indices[0] | (asset_infos[star_shift].palette_index << 8);
+	    ppu.background[star[0] + star[1] * PPU466::BackgroundWidth] = background_entry(star_shift, 0);
 	}
 	
 	//--- actually draw ---
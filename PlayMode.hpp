@@ -2,9 +2,7 @@
 #include "Mode.hpp"
 #include "asset_converter.hpp"
 #include "data_path.hpp"
-#include "read_write_chunk.hpp"
 #include <glm/glm.hpp>
-#include <fstream>
 #include <vector>
 #include <deque>
 
@@ -15,14 +13,10 @@ struct PlayMode : Mode {
 	//functions called by main loop:
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) override;
 	virtual void update(float elapsed) override;
-	virtual void draw(glm::uvec2 const &drawable_size) override;
+	virtual void draw(glm::uvec2 const &drawable_size, float alpha) override;
 
 	// assets
 
-	// tile
-	std::vector<PPU466::Tile> converted_tiles{};
-	// palette
-	std::vector<PPU466::Palette> converted_palettes{};
 	// read asset info
 	std::vector<AssetInfo> asset_infos{};
 
@@ -30,6 +24,10 @@ struct PlayMode : Mode {
 	//stars position
 	std::vector<glm::u16vec2> stars_pos;
 
+	// tile indices of the spiked ball column (drawn as one metasprite)
+	std::vector<uint8_t> spike_column_tiles;
+	std::vector<uint8_t> spike_column_flips;
+
 	//----- game state -----
 	bool dying = false;
 	bool dead = false;
@@ -97,6 +95,11 @@ struct PlayMode : Mode {
 	double killer_y_position = 0.0f;
     double killer_move_magnitude = 15.0f;
 
+	// state at the start of the latest update, so draw can blend toward the current state
+	glm::vec2 previous_player_pos = player.pos;
+	double previous_background_pos_x = background_pos_x;
+	double previous_killer_y_position = killer_y_position;
+
     // total elapsed time
     double total_elapsed = 0.0f;
 
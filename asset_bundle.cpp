@@ -0,0 +1,167 @@
+#include "asset_bundle.hpp"
+
+#include <cassert>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr char BundleMagic[4] = {'a', 'b', 'n', 'd'};
+static constexpr uint32_t BundleVersion = 1;
+static constexpr uint32_t SectionAlignment = 16;
+
+void AssetBundleWriter::add_bytes(std::string const &magic, void const *data, size_t size) {
+	assert(magic.size() == 4);
+	sections.emplace_back();
+	Section &section = sections.back();
+	section.magic = magic;
+	if (compression_level != 0 && size >= compress_min_size) {
+		deflate_chunk_data(data, size, compression_level, &section.bytes);
+		if (section.bytes.size() < size) {
+			section.raw_size = uint32_t(size);
+			return;
+		}
+		section.bytes.clear(); //(didn't get smaller, so store it raw)
+	}
+	section.bytes.assign(reinterpret_cast< char const * >(data), reinterpret_cast< char const * >(data) + size);
+}
+
+void AssetBundleWriter::write(std::ostream *to_) const {
+	assert(to_);
+	auto &to = *to_;
+
+	AssetBundle::Header header;
+	std::memcpy(header.magic, BundleMagic, 4);
+	header.version = BundleVersion;
+	header.count = uint32_t(sections.size());
+	header.reserved = 0;
+
+	//lay out sections after the table of contents, each aligned:
+	std::vector< AssetBundle::Entry > entries(sections.size());
+	size_t offset = sizeof(header) + entries.size() * sizeof(AssetBundle::Entry);
+	for (size_t i = 0; i < sections.size(); ++i) {
+		offset = (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+		std::memcpy(entries[i].magic, sections[i].magic.data(), 4);
+		entries[i].offset = uint32_t(offset);
+		entries[i].size = uint32_t(sections[i].bytes.size());
+		entries[i].raw_size = sections[i].raw_size;
+		offset += sections[i].bytes.size();
+	}
+	if (offset > UINT32_MAX) throw std::runtime_error("Asset bundle is too large.");
+
+	to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	to.write(reinterpret_cast< char const * >(entries.data()), entries.size() * sizeof(AssetBundle::Entry));
+	size_t written = sizeof(header) + entries.size() * sizeof(AssetBundle::Entry);
+	static const char zeros[SectionAlignment] = {};
+	for (size_t i = 0; i < sections.size(); ++i) {
+		to.write(zeros, entries[i].offset - written);
+		to.write(sections[i].bytes.data(), sections[i].bytes.size());
+		written = entries[i].offset + sections[i].bytes.size();
+	}
+}
+
+AssetBundle::AssetBundle(std::string const &filename_) : filename(filename_) {
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open asset bundle '" + filename + "'.");
+	file_handle = file;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of asset bundle '" + filename + "'.");
+	}
+	size = size_t(file_size.QuadPart);
+	if (size > 0) {
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			CloseHandle(file);
+			throw std::runtime_error("Failed to map asset bundle '" + filename + "'.");
+		}
+		mapping_handle = mapping;
+		data = reinterpret_cast< uint8_t const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!data) {
+			CloseHandle(mapping);
+			CloseHandle(file);
+			throw std::runtime_error("Failed to map asset bundle '" + filename + "'.");
+		}
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) throw std::runtime_error("Failed to open asset bundle '" + filename + "'.");
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of asset bundle '" + filename + "'.");
+	}
+	size = size_t(info.st_size);
+	if (size > 0) {
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Failed to map asset bundle '" + filename + "'.");
+		}
+		data = reinterpret_cast< uint8_t const * >(mapped);
+	}
+	close(fd); //(the mapping stays valid after the file is closed)
+#endif
+
+	//check the header and table of contents, so section() only needs to check types:
+	auto fail = [this](std::string const &why) {
+		std::string message = "Asset bundle '" + filename + "' is malformed: " + why + ".";
+		unmap();
+		throw std::runtime_error(message);
+	};
+	Header header;
+	if (size < sizeof(header)) fail("too short for header");
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, BundleMagic, 4) != 0) fail("unexpected magic number");
+	if (header.version != BundleVersion) fail("unsupported version " + std::to_string(header.version));
+	if ((size - sizeof(header)) / sizeof(Entry) < header.count) fail("table of contents past end of file");
+	entries = reinterpret_cast< Entry const * >(data + sizeof(header));
+	entry_count = header.count;
+	for (uint32_t i = 0; i < entry_count; ++i) {
+		Entry const &entry = entries[i];
+		if (entry.offset % SectionAlignment != 0) fail("section " + std::to_string(i) + " is not aligned");
+		if (entry.offset > size || entry.size > size - entry.offset) fail("section " + std::to_string(i) + " past end of file");
+	}
+}
+
+AssetBundle::~AssetBundle() {
+	unmap();
+}
+
+void AssetBundle::unmap() {
+#if defined(_WIN32)
+	if (data) UnmapViewOfFile(data);
+	if (mapping_handle) CloseHandle(reinterpret_cast< HANDLE >(mapping_handle));
+	if (file_handle) CloseHandle(reinterpret_cast< HANDLE >(file_handle));
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+#else
+	if (data) munmap(const_cast< uint8_t * >(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+	entries = nullptr;
+	entry_count = 0;
+}
+
+bool AssetBundle::has_section(std::string const &magic) const {
+	for (uint32_t i = 0; i < entry_count; ++i) {
+		if (std::string(entries[i].magic, 4) == magic) return true;
+	}
+	return false;
+}
+
+AssetBundle::Entry const &AssetBundle::find(std::string const &magic) const {
+	for (uint32_t i = 0; i < entry_count; ++i) {
+		if (std::string(entries[i].magic, 4) == magic) return entries[i];
+	}
+	throw std::runtime_error("Asset bundle '" + filename + "' has no section '" + magic + "'.");
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+/*
+ * An asset bundle is a single file holding several typed arrays ("sections"),
+ * laid out so that it can be memory-mapped and used in place:
+ *
+ * |ab|nd|..|..| <-- four byte magic number "abnd"
+ * |ve|rs|io|n.| <-- four byte (native endian) version (1)
+ * |co|un|t.|..| <-- four byte number of sections
+ * |00|00|00|00| <-- reserved (zero)
+ * |ma|gi|c.|..|of|fs|et|..|si|ze|..|..|rs|rs|rs|rs| * count <-- table of contents
+ * ...section data, each starting at a multiple of 16 bytes from the start of the file...
+ *
+ * Sections are looked up by their four byte magic (the same magics as the chunk files in read_write_chunk.hpp).
+ * A section is either stored raw (rs == 0), so it can be used in place, or as a zlib stream that inflates to rs bytes.
+ */
+
+#include "read_write_chunk.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//Builds a bundle in memory; sections are written in the order they were added:
+struct AssetBundleWriter {
+	//sections of at least compress_min_size bytes are compressed at this zlib level (1 ... 9; 0 stores everything raw):
+	// (small sections aren't worth it -- raw sections are used in place, without any copy)
+	int compression_level = 0;
+	size_t compress_min_size = 1024;
+
+	template< typename T >
+	void add(std::string const &magic, std::vector< T > const &data) {
+		add_bytes(magic, data.data(), data.size() * sizeof(T));
+	}
+	void add_bytes(std::string const &magic, void const *data, size_t size);
+
+	void write(std::ostream *to) const;
+
+	struct Section {
+		std::string magic;
+		std::vector< char > bytes; //(compressed, if raw_size != 0)
+		uint32_t raw_size = 0;
+	};
+	std::vector< Section > sections;
+};
+
+//A read-only memory mapping of a bundle file:
+// (the constructor throws std::runtime_error if the file can't be mapped or its table of contents is malformed)
+struct AssetBundle {
+	explicit AssetBundle(std::string const &filename);
+	~AssetBundle();
+	AssetBundle(AssetBundle const &) = delete;
+	AssetBundle &operator=(AssetBundle const &) = delete;
+
+	bool has_section(std::string const &magic) const;
+
+	//view of a section's data, in place in the mapping:
+	// throws if the section is missing or compressed, or its size or alignment don't fit T
+	template< typename T >
+	ChunkView< T > section(std::string const &magic) const {
+		Entry const &entry = find(magic);
+		if (entry.raw_size != 0) {
+			throw std::runtime_error("Bundle section '" + magic + "' is compressed (use read_section).");
+		}
+		return view_array< T >(data + entry.offset, entry.size);
+	}
+
+	//view of a section's data that also handles compressed sections, by inflating them into *storage:
+	// (raw sections are still viewed in place, and *storage is left alone)
+	template< typename T >
+	ChunkView< T > read_section(std::string const &magic, std::vector< T > *storage) const {
+		assert(storage);
+		Entry const &entry = find(magic);
+		if (entry.raw_size == 0) return view_array< T >(data + entry.offset, entry.size);
+		if (entry.raw_size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of bundle section '" + magic + "' not divisible by element size");
+		}
+		storage->resize(entry.raw_size / sizeof(T));
+		inflate_chunk_data(data + entry.offset, entry.size, storage->data(), entry.raw_size);
+		return ChunkView< T >{storage->data(), storage->size()};
+	}
+
+	//------ internals ------
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint32_t count;
+		uint32_t reserved;
+	};
+	static_assert(sizeof(Header) == 16, "header is packed");
+
+	struct Entry {
+		char magic[4];
+		uint32_t offset; //from the start of the file
+		uint32_t size; //in bytes, as stored
+		uint32_t raw_size; //size once inflated if the section is compressed, otherwise zero
+	};
+	static_assert(sizeof(Entry) == 16, "table of contents entry is packed");
+
+	Entry const &find(std::string const &magic) const;
+	void unmap(); //(used by the destructor, and by the constructor when it fails)
+
+	std::string filename;
+	uint8_t const *data = nullptr; //the whole file
+	size_t size = 0;
+	Entry const *entries = nullptr;
+	uint32_t entry_count = 0;
+
+#if defined(_WIN32)
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+#endif
+};
@@ -7,15 +7,25 @@
 #include "read_write_chunk.hpp"
 #include "data_path.hpp"
 #include "ssize_t.hpp"
+#include "tile_codec.hpp"
 #include <iostream>
 #include <glm/glm.hpp>
 #include <algorithm>
 #include <fstream>
+#include <sstream>
+#include <iterator>
+#include <cstring>
+#include <unordered_map>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <thread>
+#include <tuple>
 
 
 
-/* Hard code the order of assets we read */
-static const std::vector<std::string> asset_names = {
+/* Hard code the order of assets we read (unless ConvertOptions::asset_names lists others) */
+static const std::vector<std::string> game_asset_names = {
     // order is important! The coressponding png file is assets_names[i] + ".png"
     "char_stand",
     "char_crouch",
@@ -57,6 +67,42 @@ static std::vector<PPU466::Tile> tiles;
 static std::vector<PPU466::Palette> palettes;
 static std::vector<AssetInfo> asset_infos;
 
+/**
+ * A color as one packed integer (and back), so colors compare and sort as single values
+ */
+static uint32_t color_key(const glm::u8vec4& color) {
+    return uint32_t(color.r) | (uint32_t(color.g) << 8) | (uint32_t(color.b) << 16) | (uint32_t(color.a) << 24);
+}
+
+static glm::u8vec4 key_color(uint32_t key) {
+    return glm::u8vec4(key & 0xff, (key >> 8) & 0xff, (key >> 16) & 0xff, key >> 24);
+}
+
+/**
+ * Hash index over the global tiles vector (tile -> index), so a tile can be found in O(1)
+ * instead of comparing it against every tile found so far
+ */
+struct TileHash {
+    size_t operator()(const PPU466::Tile& tile) const {
+        uint64_t bit0, bit1;
+        std::memcpy(&bit0, tile.bit0.data(), sizeof(bit0));
+        std::memcpy(&bit1, tile.bit1.data(), sizeof(bit1));
+        // mix both bit planes with the splitmix64 finalizer
+        uint64_t h = bit0 ^ (bit1 * 0x9e3779b97f4a7c15ULL);
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+        return size_t(h ^ (h >> 31));
+    }
+};
+
+struct TileEqual {
+    bool operator()(const PPU466::Tile& a, const PPU466::Tile& b) const {
+        return a.bit0 == b.bit0 && a.bit1 == b.bit1;
+    }
+};
+
+static std::unordered_map<PPU466::Tile, uint32_t, TileHash, TileEqual> tile_lookup;
+
 
 /**
  * Helper function for debug
@@ -86,14 +132,42 @@ void print_palette(const PPU466::Palette p) {
     }
 }
 
+/**
+ * Mirror a tile (flips is a combination of PPU466::FlipX and PPU466::FlipY),
+ * the result is what the PPU draws for this tile with those flip bits set
+ */
+PPU466::Tile flip_tile(const PPU466::Tile& tile, uint8_t flips) {
+    PPU466::Tile res = tile;
+    if (flips & PPU466::FlipX) {
+        // pixel i of a row is bit i, so mirroring a row reverses its bits
+        auto reverse_bits = [](uint8_t b) {
+            b = (uint8_t)(((b & 0xf0) >> 4) | ((b & 0x0f) << 4));
+            b = (uint8_t)(((b & 0xcc) >> 2) | ((b & 0x33) << 2));
+            b = (uint8_t)(((b & 0xaa) >> 1) | ((b & 0x55) << 1));
+            return b;
+        };
+        for (int i = 0; i < TILE_HEIGHT; i++) {
+            res.bit0[i] = reverse_bits(res.bit0[i]);
+            res.bit1[i] = reverse_bits(res.bit1[i]);
+        }
+    }
+    if (flips & PPU466::FlipY) {
+        std::reverse(res.bit0.begin(), res.bit0.end());
+        std::reverse(res.bit1.begin(), res.bit1.end());
+    }
+    return res;
+}
+
 /**
  * Helper function for debug
  */
 void print_tile(const PPU466::Tile tile) {
+    uint8_t indices[TILE_WIDTH * TILE_HEIGHT];
+    decode_tile(tile, indices);
     for(int i=TILE_HEIGHT - 1; i >= 0; i--) {// from last row to first row
         for(int j=0; j < TILE_WIDTH; j++) {
             // (j, i)
-            int color_idx = ((tile.bit0[i] >> j) & 1) | (((tile.bit1[i] >> j) & 1) << 1);
+            int color_idx = indices[i * TILE_WIDTH + j];
             std::cout<<color_idx<<" ";
         }
         std::cout<<std::endl;
@@ -114,16 +188,14 @@ void debug_reconstruct_png(const AssetInfo& info, const std::string& save_dir, c
     int cons_idx = 0;
     for(uint32_t i=0; i< rows; i++) {
         for(uint32_t j = 0; j < cols; j++) {
-            PPU466::Tile tile = tiles[info.tile_indices[j + i * cols]];
+            PPU466::Tile tile = flip_tile(tiles[info.tile_indices[j + i * cols]], info.tile_flip(j + i * cols));
             PPU466::Palette palette = palettes[info.palette_index];
             std::vector<glm::u8vec4> data;
 
-            for(int m=0; m < TILE_HEIGHT; m++) {
-                for (int n=0; n < TILE_WIDTH; n++) {
-                    // pixel at (n, m)
-                    int color_idx = (((tile.bit1[m] >> n) & 1) << 1) | ((tile.bit0[m] >> n) & 1);
-                    data.push_back(palette[color_idx]);
-                }
+            uint8_t indices[TILE_WIDTH * TILE_HEIGHT];
+            decode_tile(tile, indices);
+            for(int m=0; m < TILE_HEIGHT * TILE_WIDTH; m++) {
+                data.push_back(palette[indices[m]]);
             }
             save_png(save_dir + "/" + asset_name + "_" + std::to_string(cons_idx++) + ".png",
                      glm::uvec2(TILE_WIDTH, TILE_HEIGHT), &(data[0]), LowerLeftOrigin);
@@ -131,94 +203,107 @@ void debug_reconstruct_png(const AssetInfo& info, const std::string& save_dir, c
     }
 }
 
+static_assert(PALETTE_SIZE == 4, "get_palette and tile_png compare against each palette entry by hand");
+
 /**
- * Parse a single png's (not necessarily a 8*8 png data) data vector, and get its palette
+ * Get a png's (not necessarily 8*8) palette by walking its pixels in place:
+ * (0,0,0,0) first, then the other colors in the order they first appear
  */
-PPU466::Palette get_palette(const std::vector<glm::u8vec4>& data) {
-    std::vector<glm::u8vec4> colors;
-    // the first one is always 0,0,0,0
-    colors.push_back(glm::u8vec4(0, 0, 0, 0));
-    for(auto& color: data) {
-        if(std::find(colors.begin(), colors.end(), color) == colors.end()) {
-            colors.push_back(color);
-            assert(colors.size() <= PALETTE_SIZE); // at most 4 different color color
+PPU466::Palette get_palette(const glm::u8vec4 *data, size_t count) {
+    // the first one is always 0,0,0,0, the rest are filled as colors are found
+    // (so unfilled entries, also 0, never match a color that isn't there yet)
+    uint32_t keys[PALETTE_SIZE] = {0};
+    uint8_t n_colors = 1;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t key = color_key(data[i]);
+        // compare against every entry at once, so the only branch is the (rare) new color
+        bool seen = (key == keys[0]) | (key == keys[1]) | (key == keys[2]) | (key == keys[3]);
+        if (seen) {
+            continue;
         }
+        if (n_colors == PALETTE_SIZE) {
+            throw std::runtime_error("More than " + std::to_string(PALETTE_SIZE) + " colors in one png");
+        }
+        keys[n_colors++] = key;
     }
 
-    // note it is possible that the size of colors < 4, fill with (0,0,0,0)
+    // note it is possible that there are < 4 colors, the rest stay (0,0,0,0)
     PPU466::Palette res;
-    for(size_t i=0; i < PALETTE_SIZE; i++) {
-        if(i < colors.size()) {
-            res[i] = colors[i];
-        } else {
-            res[i] = glm::u8vec4(0, 0, 0, 0);
-        }
+    for (size_t i = 0; i < PALETTE_SIZE; i++) {
+        res[i] = key_color(keys[i]);
     }
     return res;
 }
 
 /**
- * Construct a new tile based on the 8*8 png data and its corresponding palette
+ * Cut a png into 8*8 tiles (the lower left 8*8 is the first one, then along each row of tiles), reading the
+ * pixels in place and writing each pixel's palette index straight into its tile's bit planes
  *
- * @param data png data of size 8*8
- * @param palette this png's corresponding palette
- * @return tile rep for this png
+ * @param data png data of size width*height, lower left origin
+ * @param palette this png's palette (from get_palette), every pixel's color must be in it
+ * @param tiles_ the tiles are appended here
  */
-PPU466::Tile get_tile(const std::vector<glm::u8vec4>& data, const PPU466::Palette palette) {
-    assert(data.size() == TILE_WIDTH * TILE_HEIGHT);
-    PPU466::Tile tile{};
-
-    for (int i = 0; i < TILE_HEIGHT; i ++) {
-        for (int j = 0; j < TILE_WIDTH; j ++) {
-            // pixel at (j, i)
-            glm::u8vec4 color = data[i * TILE_WIDTH + j];
-            auto idx = (size_t)(std::find(palette.begin(), palette.end(), color) - palette.begin());
-
-            assert(idx < palette.size());
-            tile.bit0[i] |= ((idx & 1) << j);
-            tile.bit1[i] |= (((idx & 2) >> 1) << j);
-        }
-    }
-    return tile;
-}
-
-/**
- * Split one large png data into multiple 8*8 small png data. The lower left 8*8 is the first one
- * @param png_data large png data
- * @return a vector of 8*8 png data
- */
-std::vector<std::vector<glm::u8vec4>> split_png_data(const std::vector<glm::u8vec4>& png_data, uint32_t width, uint32_t height) {
+void tile_png(const glm::u8vec4 *data, uint32_t width, uint32_t height, const PPU466::Palette& palette,
+              std::vector<PPU466::Tile> *tiles_) {
     assert(width % TILE_WIDTH == 0);
     assert(height % TILE_HEIGHT == 0);
+    assert(tiles_);
+    auto &out = *tiles_;
+
+    uint32_t keys[PALETTE_SIZE];
+    for (int i = 0; i < PALETTE_SIZE; i++) {
+        keys[i] = color_key(palette[i]);
+    }
 
     uint32_t cols = width / TILE_WIDTH;
     uint32_t rows = height / TILE_HEIGHT;
-    std::vector<std::vector<glm::u8vec4>> small_datas;
-
-    for (uint32_t i=0; i < rows; i++) {
-        for (uint32_t j=0; j < cols; j++) {
-            // the small png at (i, j), read this png's data from low left
-            std::vector<glm::u8vec4> small_data(TILE_WIDTH * TILE_HEIGHT);
-            for(int m=0; m < TILE_HEIGHT; m++) {
-                for(int n=0; n < TILE_WIDTH; n ++) {
-                    small_data[m * TILE_WIDTH + n] = png_data[(i * TILE_HEIGHT + m) * cols * TILE_WIDTH + (j * TILE_WIDTH) + n];
+    out.reserve(out.size() + size_t(cols) * rows);
+    for (uint32_t i = 0; i < rows; i++) {
+        for (uint32_t j = 0; j < cols; j++) {
+            // the tile at (i, j): bit x of row y holds the low (bit0) / high (bit1) bit of pixel (x, y)'s index
+            PPU466::Tile tile;
+            for (int m = 0; m < TILE_HEIGHT; m++) {
+                const glm::u8vec4 *row = data + size_t(i * TILE_HEIGHT + m) * width + size_t(j) * TILE_WIDTH;
+                uint8_t bit0 = 0;
+                uint8_t bit1 = 0;
+                for (int n = 0; n < TILE_WIDTH; n++) {
+                    // the first matching palette entry, picked without branches (colors change too often to predict)
+                    uint32_t key = color_key(row[n]);
+                    uint8_t idx = (key == keys[3]) ? 3 : 0;
+                    idx = (key == keys[2]) ? 2 : idx;
+                    idx = (key == keys[1]) ? 1 : idx;
+                    idx = (key == keys[0]) ? 0 : idx;
+                    assert(key == keys[idx]);
+                    bit0 |= uint8_t((idx & 1) << n);
+                    bit1 |= uint8_t((idx >> 1) << n);
                 }
+                tile.bit0[m] = bit0;
+                tile.bit1[m] = bit1;
             }
-            small_datas.push_back(small_data);
+            out.push_back(tile);
         }
     }
-    return small_datas;
 }
 
 /**
- * Search a certain tile from the global tiles vector
+ * Search a certain tile from the global tiles vector (through tile_lookup)
  *
+ * @param reuse_mirrored also look for a tile that is a mirror of target_tile
+ * @param flips set to the flip bits that turn the found tile into target_tile (0 for an exact match)
  * @return idx if found, -1 otherwise
  */
-ssize_t search_tile(const PPU466::Tile& target_tile) {
-    for(size_t i = 0; i < tiles.size(); i++) {
-        if (target_tile.bit0 == tiles[i].bit0 && target_tile.bit1 == tiles[i].bit1) {
-            return i;
+ssize_t search_tile(const PPU466::Tile& target_tile, bool reuse_mirrored, uint8_t *flips) {
+    // exact match first, so a symmetric tile is never stored flipped
+    static const uint8_t flip_options[] = {0, PPU466::FlipX, PPU466::FlipY, PPU466::FlipX | PPU466::FlipY};
+    for (uint8_t f: flip_options) {
+        if (f != 0 && !reuse_mirrored) {
+            break;
+        }
+        // flipping is its own inverse: if flip(stored, f) == target then stored == flip(target, f)
+        auto found = tile_lookup.find(flip_tile(target_tile, f));
+        if (found != tile_lookup.end()) {
+            *flips = f;
+            return found->second;
         }
     }
     return -1;
@@ -246,91 +331,628 @@ ssize_t search_palette(const PPU466::Palette target_palette) {
     return -1;
 }
 
-void parse_pngs(const std::string& png_dir_name) {
-    for(auto& asset_name: asset_names) {
+/**
+ * Run fn(0), fn(1), ..., fn(count - 1) on a pool of worker threads (the calling thread is one of them).
+ * Exceptions are rethrown on the calling thread afterwards, lowest index first, so the error reported
+ * is the one a sequential loop would have hit first
+ */
+static void parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+    size_t n_threads = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<size_t> next(0);
+    std::vector<std::exception_ptr> errors(count);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                fn(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < n_threads; t++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    for (auto& error: errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+/**
+ * Re-encode a tile whose color indices refer to palette 'from' so that they refer to palette 'to'
+ * (every color of 'from' must be in 'to'). Each color gets the index tile_png would give it in 'to',
+ * so this is the same as building the tile from its png data with palette 'to'
+ */
+PPU466::Tile remap_tile(const PPU466::Tile& tile, const PPU466::Palette& from, const PPU466::Palette& to) {
+    uint8_t index_map[PALETTE_SIZE];
+    for (int i = 0; i < PALETTE_SIZE; i++) {
+        auto idx = (size_t)(std::find(to.begin(), to.end(), from[i]) - to.begin());
+        assert(idx < to.size());
+        index_map[i] = (uint8_t)idx;
+    }
+    uint8_t indices[TILE_WIDTH * TILE_HEIGHT];
+    decode_tile(tile, indices);
+    for (int i = 0; i < TILE_WIDTH * TILE_HEIGHT; i++) {
+        indices[i] = index_map[indices[i]];
+    }
+    return encode_tile(indices);
+}
+
+/**
+ * 64-bit FNV-1a hash of a file's contents (used to tell whether a png changed since the manifest was written)
+ */
+uint64_t hash_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Failed to open '" + path + "'");
+    }
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    char buffer[4096];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+        for (std::streamsize i = 0; i < file.gcount(); i++) {
+            hash = (hash ^ (uint8_t)buffer[i]) * 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+/**
+ * What decoding one png produced: its size, its own palette, and its tiles with indices into that palette
+ */
+struct DecodedPng {
+    uint64_t content_hash = 0;
+    glm::uvec2 size = glm::uvec2(0);
+    PPU466::Palette palette;
+    std::vector<PPU466::Tile> tiles;
+};
+
+// asset name -> decoded png
+typedef std::unordered_map<std::string, DecodedPng> Manifest;
+
+static const uint32_t MANIFEST_VERSION = 1;
+
+/**
+ * Read a manifest written by write_manifest, a missing or unreadable manifest is treated as empty
+ */
+Manifest read_manifest(const std::string& path) {
+    Manifest manifest;
+    std::ifstream from(path, std::ios::binary);
+    if (!from) {
+        return manifest;
+    }
+    try {
+        std::vector<uint32_t> version;
+        std::vector<char> names;
+        std::vector<StoredManifestEntry> entries;
+        std::vector<PPU466::Tile> manifest_tiles;
+        read_chunk(from, Converter::MANIFEST_VERSION_MAGIC, &version);
+        if (version.size() != 1 || version[0] != MANIFEST_VERSION) {
+            return manifest;
+        }
+        read_chunk(from, Converter::MANIFEST_NAME_MAGIC, &names);
+        read_chunk(from, Converter::MANIFEST_ENTRY_MAGIC, &entries);
+        read_chunk(from, Converter::MANIFEST_TILE_MAGIC, &manifest_tiles);
+        for (auto const& entry: entries) {
+            if (entry.name_begin > entry.name_end || entry.name_end > names.size()
+                || entry.tile_begin > entry.tile_end || entry.tile_end > manifest_tiles.size()) {
+                throw std::runtime_error("Manifest entry out of range");
+            }
+            DecodedPng& png = manifest[std::string(names.begin() + entry.name_begin, names.begin() + entry.name_end)];
+            png.content_hash = entry.content_hash;
+            png.size = glm::uvec2(entry.width, entry.height);
+            png.palette = entry.palette;
+            png.tiles.assign(manifest_tiles.begin() + entry.tile_begin, manifest_tiles.begin() + entry.tile_end);
+        }
+    } catch (std::runtime_error& e) {
+        std::cerr<<"Ignoring manifest '"<<path<<"' ("<<e.what()<<")"<<std::endl;
+        manifest.clear();
+    }
+    return manifest;
+}
+
+/**
+ * Write one manifest entry per asset, in asset order (so the same inputs always give the same file)
+ *
+ * @param compression_level zlib level for the (large) tile chunk, 0 to store it raw
+ */
+void write_manifest(const std::vector<std::string>& asset_names, const std::vector<DecodedPng>& pngs,
+                    int compression_level, std::ostream *to_) {
+    assert(to_);
+    auto &to = *to_;
+    assert(pngs.size() == asset_names.size());
+
+    std::vector<char> names;
+    std::vector<StoredManifestEntry> entries;
+    std::vector<PPU466::Tile> manifest_tiles;
+    for (size_t i = 0; i < pngs.size(); i++) {
+        StoredManifestEntry entry; // (no padding, every field is set below)
+        entry.content_hash = pngs[i].content_hash;
+        entry.name_begin = (uint32_t)names.size();
+        names.insert(names.end(), asset_names[i].begin(), asset_names[i].end());
+        entry.name_end = (uint32_t)names.size();
+        entry.width = pngs[i].size[0];
+        entry.height = pngs[i].size[1];
+        entry.tile_begin = (uint32_t)manifest_tiles.size();
+        manifest_tiles.insert(manifest_tiles.end(), pngs[i].tiles.begin(), pngs[i].tiles.end());
+        entry.tile_end = (uint32_t)manifest_tiles.size();
+        entry.palette = pngs[i].palette;
+        entries.push_back(entry);
+    }
+
+    write_chunk(Converter::MANIFEST_VERSION_MAGIC, std::vector<uint32_t>{MANIFEST_VERSION}, &to);
+    write_chunk(Converter::MANIFEST_NAME_MAGIC, names, &to);
+    write_chunk(Converter::MANIFEST_ENTRY_MAGIC, entries, &to);
+    if (compression_level != 0) {
+        write_compressed_chunk(Converter::MANIFEST_TILE_MAGIC, manifest_tiles, &to, compression_level);
+    } else {
+        write_chunk(Converter::MANIFEST_TILE_MAGIC, manifest_tiles, &to);
+    }
+}
+
+/**
+ * Write 'bytes' to 'path' unless the file already holds exactly these bytes
+ *
+ * @return true if the file was written
+ */
+bool write_if_changed(const std::string& path, const std::string& bytes) {
+    {
+        std::ifstream existing(path, std::ios::binary);
+        if (existing) {
+            std::string old_bytes((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+            if (old_bytes == bytes) {
+                return false;
+            }
+        }
+    }
+    std::ofstream file(path, std::ios::binary);
+    file.write(bytes.data(), bytes.size());
+    if (!file) {
+        throw std::runtime_error("Failed to write '" + path + "'");
+    }
+    return true;
+}
+
+/**
+ * Palette packing (ConvertOptions::pack_palettes):
+ * instead of giving each png the first palette that already holds its colors (in asset order),
+ * look at the colors of every png together:
+ *    (1) find the fewest palettes (3 colors + transparent each) that cover every png's colors,
+ *    (2) choose the order of colors in each palette, and which palette a png uses when more than one
+ *        covers it, so that as many tiles as possible come out the same (and are stored once)
+ */
+
+// a set of (non-transparent) colors, as sorted color keys
+typedef std::vector<uint32_t> ColorSet;
+
+static ColorSet color_set(const PPU466::Palette& palette) {
+    ColorSet set;
+    for (auto& color: palette) {
+        uint32_t key = color_key(color);
+        if (key != 0 && std::find(set.begin(), set.end(), key) == set.end()) {
+            set.push_back(key);
+        }
+    }
+    std::sort(set.begin(), set.end());
+    return set;
+}
+
+static ColorSet color_union(const ColorSet& a, const ColorSet& b) {
+    ColorSet res;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(res));
+    return res;
+}
+
+/**
+ * (1): cover 'sets' with as few bins of at most PALETTE_SIZE - 1 colors as possible.
+ * Branch and bound over which bin each set goes to (largest sets first), starting from the first-fit answer;
+ * the search gives up after a fixed number of steps and keeps the best packing found so far
+ */
+static std::vector<ColorSet> pack_color_sets(std::vector<ColorSet> sets) {
+    const size_t max_colors = PALETTE_SIZE - 1;
+
+    // identical sets and sets contained in another set never need a bin of their own
+    std::sort(sets.begin(), sets.end());
+    sets.erase(std::unique(sets.begin(), sets.end()), sets.end());
+    std::vector<ColorSet> maximal;
+    for (size_t i = 0; i < sets.size(); i++) {
+        bool contained = false;
+        for (size_t j = 0; j < sets.size() && !contained; j++) {
+            contained = j != i && sets[j].size() > sets[i].size()
+                && std::includes(sets[j].begin(), sets[j].end(), sets[i].begin(), sets[i].end());
+        }
+        if (!contained) {
+            maximal.push_back(sets[i]);
+        }
+    }
+    std::stable_sort(maximal.begin(), maximal.end(), [](const ColorSet& a, const ColorSet& b) {
+        return a.size() > b.size();
+    });
+
+    // first fit
+    std::vector<ColorSet> best;
+    for (auto& set: maximal) {
+        auto bin = std::find_if(best.begin(), best.end(), [&](const ColorSet& b) {
+            return color_union(b, set).size() <= max_colors;
+        });
+        if (bin == best.end()) {
+            best.push_back(set);
+        } else {
+            *bin = color_union(*bin, set);
+        }
+    }
+
+    std::vector<ColorSet> bins;
+    uint32_t steps_left = 1000000;
+    std::function<void(size_t)> search = [&](size_t next) {
+        if (bins.size() >= best.size() || steps_left == 0) {
+            return;
+        }
+        steps_left--;
+        if (next == maximal.size()) {
+            best = bins;
+            return;
+        }
+        for (size_t b = 0; b < bins.size(); b++) {
+            ColorSet merged = color_union(bins[b], maximal[next]);
+            if (merged.size() <= max_colors) {
+                std::swap(bins[b], merged);
+                search(next + 1);
+                std::swap(bins[b], merged);
+            }
+        }
+        // (all empty bins are alike, so only one new bin is tried)
+        bins.push_back(maximal[next]);
+        search(next + 1);
+        bins.pop_back();
+    };
+    search(0);
+    return best;
+}
+
+/**
+ * Tile used to count distinct tiles: the tile itself, or (if mirrored tiles are reused) the smallest of its mirrors,
+ * so that tiles search_tile would treat as the same have the same canonical tile
+ */
+static PPU466::Tile canonical_tile(const PPU466::Tile& tile, bool reuse_mirrored) {
+    PPU466::Tile best = tile;
+    if (reuse_mirrored) {
+        static const uint8_t flip_options[] = {PPU466::FlipX, PPU466::FlipY, PPU466::FlipX | PPU466::FlipY};
+        for (uint8_t f: flip_options) {
+            PPU466::Tile flipped = flip_tile(tile, f);
+            if (std::tie(flipped.bit0, flipped.bit1) < std::tie(best.bit0, best.bit1)) {
+                best = flipped;
+            }
+        }
+    }
+    return best;
+}
+
+/**
+ * (1) + (2): fill 'palettes' and set each png's palette index
+ */
+static void pack_palettes(const std::vector<DecodedPng>& pngs, bool reuse_mirrored, std::vector<uint8_t> *palette_indices_) {
+    assert(palette_indices_);
+    auto& palette_indices = *palette_indices_;
+
+    std::vector<ColorSet> sets;
+    for (auto& png: pngs) {
+        sets.push_back(color_set(png.palette));
+    }
+    std::vector<ColorSet> bins = pack_color_sets(sets);
+
+    // every png may use any bin that holds all of its colors; start with the first
+    std::vector<std::vector<uint8_t>> choices(pngs.size());
+    for (size_t i = 0; i < pngs.size(); i++) {
+        for (size_t b = 0; b < bins.size(); b++) {
+            if (std::includes(bins[b].begin(), bins[b].end(), sets[i].begin(), sets[i].end())) {
+                choices[i].push_back((uint8_t)b);
+            }
+        }
+        assert(!choices[i].empty());
+    }
+    std::vector<uint8_t> choice(pngs.size(), 0);
+
+    // slot order of each bin's colors: slots 1..PALETTE_SIZE-1 (slot 0 is always transparent),
+    // a bin with fewer colors than slots leaves some slots transparent
+    static const uint8_t permutations[6][3] = { {0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0} };
+    std::vector<uint8_t> order(bins.size(), 0);
+
+    auto make_palette = [&](size_t b) {
+        PPU466::Palette palette;
+        palette[0] = glm::u8vec4(0, 0, 0, 0);
+        for (int slot = 0; slot < PALETTE_SIZE - 1; slot++) {
+            uint8_t c = permutations[order[b]][slot];
+            palette[slot + 1] = c < bins[b].size() ? key_color(bins[b][c]) : glm::u8vec4(0, 0, 0, 0);
+        }
+        return palette;
+    };
+
+    // number of distinct tiles with the current orders and choices
+    auto count_tiles = [&]() {
+        std::unordered_map<PPU466::Tile, uint32_t, TileHash, TileEqual> distinct;
+        for (size_t i = 0; i < pngs.size(); i++) {
+            PPU466::Palette palette = make_palette(choices[i][choice[i]]);
+            for (auto& tile: pngs[i].tiles) {
+                distinct.emplace(canonical_tile(remap_tile(tile, pngs[i].palette, palette), reuse_mirrored), 0);
+            }
+        }
+        return distinct.size();
+    };
+
+    // (2): change one bin's order or one png's choice at a time, keeping changes that reduce the tile count
+    size_t best_count = count_tiles();
+    bool improved = true;
+    while (improved) {
+        improved = false;
+        auto try_value = [&](uint8_t *value, uint8_t count) {
+            uint8_t kept = *value;
+            for (uint8_t v = 0; v < count; v++) {
+                if (v == kept) {
+                    continue;
+                }
+                *value = v;
+                size_t tile_count = count_tiles();
+                if (tile_count < best_count) {
+                    best_count = tile_count;
+                    kept = v;
+                    improved = true;
+                }
+            }
+            *value = kept;
+        };
+        for (size_t b = 0; b < bins.size(); b++) {
+            try_value(&order[b], 6);
+        }
+        for (size_t i = 0; i < pngs.size(); i++) {
+            if (choices[i].size() > 1) {
+                try_value(&choice[i], (uint8_t)choices[i].size());
+            }
+        }
+    }
+
+    palettes.clear();
+    for (size_t b = 0; b < bins.size(); b++) {
+        palettes.push_back(make_palette(b));
+    }
+    palette_indices.clear();
+    for (size_t i = 0; i < pngs.size(); i++) {
+        palette_indices.push_back(choices[i][choice[i]]);
+    }
+}
+
+ConvertStats convert_stats() {
+    ConvertStats stats;
+    stats.assets = asset_infos.size();
+    stats.palettes = palettes.size();
+    stats.tiles = tiles.size();
+    for (auto& info: asset_infos) {
+        stats.tile_references += info.tile_indices.size();
+    }
+    return stats;
+}
+
+/**
+ * Print how much of the PPU's palette and tile tables the converted assets use
+ */
+void report_budget(std::ostream& out) {
+    ConvertStats stats = convert_stats();
+    out<<"Budget: "<<stats.palettes<<"/"<<MAX_TOTAL_PALETTES<<" palettes, "
+       <<stats.tiles<<"/"<<MAX_TOTAL_TILES<<" tiles ("
+       <<stats.tile_references<<" tile references, "<<(stats.tile_references - stats.tiles)<<" shared)"<<std::endl;
+}
+
+/**
+ * Throw if the converted assets no longer fit in the PPU's tables
+ * (checked as the tables grow, so a corpus that is too big fails early with a clear message)
+ */
+static void check_budget() {
+    if (palettes.size() > MAX_TOTAL_PALETTES) {
+        throw std::runtime_error("Out of palettes: the pngs need more than " + std::to_string(MAX_TOTAL_PALETTES));
+    }
+    if (tiles.size() > MAX_TOTAL_TILES) {
+        throw std::runtime_error("Out of tiles: the pngs need more than " + std::to_string(MAX_TOTAL_TILES));
+    }
+}
+
+/**
+ * The work of parse_pngs is split into per-png steps that run in parallel (decoding, splitting, tile encoding)
+ * and merge steps that run in asset order (palette and tile indices), so the tables come out exactly
+ * as if every png had been handled one after another
+ */
+void parse_pngs(const std::string& png_dir_name, const ConvertOptions& options) {
+    tiles.clear();
+    tile_lookup.clear();
+    palettes.clear();
+    asset_infos.clear();
+
+    Manifest manifest;
+    if (!options.manifest_path.empty() && options.incremental) {
+        manifest = read_manifest(options.manifest_path);
+    }
+
+    const std::vector<std::string>& asset_names = options.asset_names.empty() ? game_asset_names : options.asset_names;
+    std::vector<std::string> paths(asset_names.size());
+    std::vector<DecodedPng> pngs(asset_names.size());
+    std::vector<uint8_t> reused(asset_names.size(), 0);
+
+    // (1) in parallel: decode each png (unless the manifest has it), find its palette and build its tiles
+    parallel_for(pngs.size(), [&](size_t i) {
+        DecodedPng& png = pngs[i];
 #if defined(_WIN32)
-        std::string png_path = png_dir_name + "\\" + asset_name + ".png";
+        paths[i] = png_dir_name + "\\" + asset_names[i] + ".png";
 #else
-        std::string png_path = png_dir_name + "/" + asset_name + ".png";
+        paths[i] = png_dir_name + "/" + asset_names[i] + ".png";
 #endif
-        std::cout<<"Parsing: "<<png_path<<std::endl;
-        glm::uvec2 size;
+        if (!options.manifest_path.empty()) {
+            png.content_hash = hash_file(paths[i]);
+            auto cached = manifest.find(asset_names[i]);
+            if (cached != manifest.end() && cached->second.content_hash == png.content_hash) {
+                png = cached->second;
+                reused[i] = 1;
+                return;
+            }
+        }
+
         std::vector<glm::u8vec4> png_data;
-        load_png(png_path, &size, &png_data, LowerLeftOrigin); // use LowerLeftOrigin to be consistent with Tile
+        load_png(paths[i], &png.size, &png_data, LowerLeftOrigin); // use LowerLeftOrigin to be consistent with Tile
 
         // Construct palette per png (we only allow 4 bit color in a png even if it contains multiple 8*8 tile)
-        PPU466::Palette new_palette = get_palette(png_data);
-        ssize_t pal_idx = search_palette(new_palette);
-        if(pal_idx < 0) {
-            //find a new palettes
-            palettes.push_back(new_palette);
-            assert(palettes.size() <= MAX_TOTAL_PALETTES);
-            pal_idx = palettes.size() - 1;
+        png.palette = get_palette(png_data.data(), png_data.size());
+        tile_png(png_data.data(), png.size[0], png.size[1], png.palette, &png.tiles);
+    });
+
+    // (2) in asset order: merge palettes into the palette table (or pack all palettes at once)
+    std::vector<uint8_t> packed_palette_indices;
+    if (options.pack_palettes) {
+        pack_palettes(pngs, options.reuse_mirrored_tiles, &packed_palette_indices);
+        check_budget();
+    }
+    for (size_t i = 0; i < pngs.size(); i++) {
+        if(options.verbose) {
+            std::cout<<(reused[i] ? "Unchanged: " : "Parsing: ")<<paths[i]<<std::endl;
+        }
+        ssize_t pal_idx;
+        if (options.pack_palettes) {
+            pal_idx = packed_palette_indices[i];
         } else {
-            // use existing palette to draw
-            new_palette = palettes[pal_idx];
+            pal_idx = search_palette(pngs[i].palette);
+            if(pal_idx < 0) {
+                //find a new palettes
+                palettes.push_back(pngs[i].palette);
+                check_budget();
+                pal_idx = palettes.size() - 1;
+            }
         }
 
+        // (AssetInfo stores the size in pixels in a byte)
+        if (pngs[i].size[0] > UINT8_MAX || pngs[i].size[1] > UINT8_MAX) {
+            throw std::runtime_error("'" + paths[i] + "' is larger than " + std::to_string(UINT8_MAX) + " pixels");
+        }
         AssetInfo info;
-        info.width = size[0];
-        info.height = size[1];
+        info.width = pngs[i].size[0];
+        info.height = pngs[i].size[1];
         info.palette_index = (uint8_t) pal_idx;
+        asset_infos.push_back(info);
+    }
 
-        std::vector<std::vector<glm::u8vec4>> small_png_datas = split_png_data(png_data, info.width, info.height);
+    // (3) in parallel: when an existing palette is used to draw, move the tiles' color indices to it
+    std::vector<std::vector<PPU466::Tile>> asset_tiles(pngs.size());
+    parallel_for(pngs.size(), [&](size_t i) {
+        const PPU466::Palette& palette = palettes[asset_infos[i].palette_index];
+        if (palette == pngs[i].palette) {
+            asset_tiles[i] = pngs[i].tiles;
+            return;
+        }
+        asset_tiles[i].reserve(pngs[i].tiles.size());
+        for (auto& tile: pngs[i].tiles) {
+            asset_tiles[i].push_back(remap_tile(tile, pngs[i].palette, palette));
+        }
+    });
 
-        for (auto& small_data: small_png_datas) {
-            // construct tile
-            PPU466::Tile new_tile = get_tile(small_data, new_palette);
-            ssize_t tile_idx = search_tile(new_tile);
+    // (4) in asset order: merge tiles into the tile table
+    for (size_t i = 0; i < pngs.size(); i++) {
+        AssetInfo& info = asset_infos[i];
+        for (auto& new_tile: asset_tiles[i]) {
+            uint8_t flips = 0;
+            ssize_t tile_idx = search_tile(new_tile, options.reuse_mirrored_tiles, &flips);
             if(tile_idx < 0) {
                 // find a new tile
                 tiles.push_back(new_tile);
-                assert(tiles.size() <= MAX_TOTAL_TILES);
+                check_budget();
                 tile_idx = (int)(tiles.size() - 1);
+                tile_lookup.emplace(new_tile, (uint32_t)tile_idx);
             }
             info.tile_indices.push_back((uint8_t)tile_idx);
+            info.tile_flips.push_back(flips);
         }
-        asset_infos.push_back(info);
-//        debug_reconstruct_png(info, png_dir_name, asset_name);
+        // most assets have no mirrored tiles, keep tile_flips empty for them
+        if(std::all_of(info.tile_flips.begin(), info.tile_flips.end(), [](uint8_t f) { return f == 0; })) {
+            info.tile_flips.clear();
+        }
+//        debug_reconstruct_png(info, png_dir_name, asset_names[i]);
     }
-}
 
-void write_asset_info_chunk(const std::vector<AssetInfo>& infos, std::ostream *to_) {
-    assert(to_);
-    auto &to = *to_;
+    if(options.verbose) {
+        report_budget(std::cout);
+    }
 
-    std::vector<uint8_t> tile_indices;
-    std::vector<StoredAssetInfo> sinfos;
+    if (!options.manifest_path.empty()) {
+        std::ostringstream manifest_data;
+        write_manifest(asset_names, pngs, options.compression_level, &manifest_data);
+        write_if_changed(options.manifest_path, manifest_data.str());
+        if(options.verbose) {
+            size_t n_reused = std::count(reused.begin(), reused.end(), 1);
+            std::cout<<"Decoded "<<(pngs.size() - n_reused)<<" png(s), reused "<<n_reused<<" unchanged png(s) from "
+                     <<options.manifest_path<<std::endl;
+        }
+    }
+}
+
+/**
+ * Flatten asset infos into the arrays they are stored as: all tile indices in one sequence,
+ * the matching flips (empty if no tile is flipped), and a StoredAssetInfo per asset
+ */
+static void store_asset_infos(const std::vector<AssetInfo>& infos, std::vector<uint8_t> *tile_indices_p,
+                              std::vector<uint8_t> *tile_flips_p, std::vector<StoredAssetInfo> *sinfos_p) {
+    auto &tile_indices = *tile_indices_p;
+    auto &tile_flips = *tile_flips_p; // parallel to tile_indices
+    auto &sinfos = *sinfos_p;
+    bool any_flips = false;
 
     for (auto const &info : infos) {
+        // zero the padding bytes too, so the data is the same every time it is written
         sinfos.emplace_back();
+        std::memset(&sinfos.back(), 0, sizeof(StoredAssetInfo));
         sinfos.back().tile_idx_begin = (uint32_t)tile_indices.size();
         tile_indices.insert(tile_indices.end(), info.tile_indices.begin(), info.tile_indices.end());
         sinfos.back().tile_idx_end = (uint32_t)tile_indices.size();
+        if (info.tile_flips.empty()) {
+            tile_flips.resize(tile_indices.size(), 0);
+        } else {
+            assert(info.tile_flips.size() == info.tile_indices.size());
+            tile_flips.insert(tile_flips.end(), info.tile_flips.begin(), info.tile_flips.end());
+            any_flips = true;
+        }
         sinfos.back().palette_index = info.palette_index;
         sinfos.back().width = info.width;
         sinfos.back().height = info.height;
     }
-
-    write_chunk(Converter::TILE_IDX_MAGIC, tile_indices, &to);
-    write_chunk(Converter::ASSET_INFO_MAGIC, sinfos, &to);
+    // without mirrored tiles the flips are left out, so the data is the same as before flips existed
+    if (!any_flips) {
+        tile_flips.clear();
+    }
 }
 
-void read_asset_info_chunk(std::istream & from, std::vector<AssetInfo> * infos_p) {
+/**
+ * Inverse of store_asset_infos (tile_flips is empty when there are no flips)
+ */
+static void load_asset_infos(ChunkView<uint8_t> tile_indices, ChunkView<uint8_t> tile_flips,
+                             ChunkView<StoredAssetInfo> sinfos, std::vector<AssetInfo> *infos_p) {
     auto & infos = *infos_p;
-
-    std::vector<uint8_t> tile_indices_sequence;
-    std::vector<StoredAssetInfo> sinfos;
-    read_chunk(from, Converter::TILE_IDX_MAGIC, &tile_indices_sequence);
-    read_chunk(from, Converter::ASSET_INFO_MAGIC, &sinfos);
+    if (!tile_flips.empty() && tile_flips.size != tile_indices.size) {
+        throw std::runtime_error("Tile flips do not match tile indices");
+    }
 
     // translate back to AssetInfo
-    for(auto const & sinfo: sinfos) {
-        std::vector<uint8_t> tile_indices(tile_indices_sequence.begin() + sinfo.tile_idx_begin,
-                                 tile_indices_sequence.begin() + sinfo.tile_idx_end);
+    for(const StoredAssetInfo& sinfo : sinfos) {
+        if (sinfo.tile_idx_begin > sinfo.tile_idx_end || sinfo.tile_idx_end > tile_indices.size) {
+            throw std::runtime_error("Asset info tile range out of bounds");
+        }
 
         AssetInfo info;
-        info.tile_indices = tile_indices;
+        info.tile_indices.assign(tile_indices.begin() + sinfo.tile_idx_begin, tile_indices.begin() + sinfo.tile_idx_end);
+        if (!tile_flips.empty()) {
+            info.tile_flips.assign(tile_flips.begin() + sinfo.tile_idx_begin, tile_flips.begin() + sinfo.tile_idx_end);
+            if(std::all_of(info.tile_flips.begin(), info.tile_flips.end(), [](uint8_t f) { return f == 0; })) {
+                info.tile_flips.clear();
+            }
+        }
         info.palette_index = sinfo.palette_index;
         info.width = sinfo.width;
         info.height = sinfo.height;
@@ -338,55 +960,128 @@ void read_asset_info_chunk(std::istream & from, std::vector<AssetInfo> * infos_p
     }
 }
 
+void write_asset_info_chunk(const std::vector<AssetInfo>& infos, std::ostream *to_) {
+    assert(to_);
+    auto &to = *to_;
+
+    std::vector<uint8_t> tile_indices;
+    std::vector<uint8_t> tile_flips;
+    std::vector<StoredAssetInfo> sinfos;
+    store_asset_infos(infos, &tile_indices, &tile_flips, &sinfos);
+
+    // asset infos go first, so they stay 4-byte aligned when the chunks are viewed in place
+    write_chunk(Converter::ASSET_INFO_MAGIC, sinfos, &to);
+    write_chunk(Converter::TILE_IDX_MAGIC, tile_indices, &to);
+    if (!tile_flips.empty()) {
+        write_chunk(Converter::TILE_FLIP_MAGIC, tile_flips, &to);
+    }
+}
+
+void read_asset_info_chunk(std::istream & from, std::vector<AssetInfo> * infos_p) {
+    std::vector<StoredAssetInfo> sinfos;
+    std::vector<uint8_t> tile_indices_sequence;
+    read_chunk(from, Converter::ASSET_INFO_MAGIC, &sinfos);
+    read_chunk(from, Converter::TILE_IDX_MAGIC, &tile_indices_sequence);
+    // optional flip chunk
+    std::vector<uint8_t> tile_flips_sequence;
+    if (from.peek() != std::char_traits<char>::eof()) {
+        read_chunk(from, Converter::TILE_FLIP_MAGIC, &tile_flips_sequence);
+    }
+
+    load_asset_infos({tile_indices_sequence.data(), tile_indices_sequence.size()},
+                     {tile_flips_sequence.data(), tile_flips_sequence.size()},
+                     {sinfos.data(), sinfos.size()}, infos_p);
+}
+
+void read_asset_info_chunk(const void *data, size_t size, std::vector<AssetInfo> * infos_p) {
+    // the chunks are viewed in place, only the (small) per-asset index lists are copied into AssetInfo
+    size_t at = 0;
+    ChunkView<StoredAssetInfo> sinfos = view_chunk<StoredAssetInfo>(data, size, &at, Converter::ASSET_INFO_MAGIC);
+    ChunkView<uint8_t> tile_indices = view_chunk<uint8_t>(data, size, &at, Converter::TILE_IDX_MAGIC);
+    // optional flip chunk
+    ChunkView<uint8_t> tile_flips;
+    if (at < size) {
+        tile_flips = view_chunk<uint8_t>(data, size, &at, Converter::TILE_FLIP_MAGIC);
+    }
+
+    load_asset_infos(tile_indices, tile_flips, sinfos, infos_p);
+}
+
+void add_asset_infos(const std::vector<AssetInfo>& infos, AssetBundleWriter * bundle_p) {
+    assert(bundle_p);
+
+    std::vector<uint8_t> tile_indices;
+    std::vector<uint8_t> tile_flips;
+    std::vector<StoredAssetInfo> sinfos;
+    store_asset_infos(infos, &tile_indices, &tile_flips, &sinfos);
+
+    bundle_p->add(Converter::TILE_IDX_MAGIC, tile_indices);
+    bundle_p->add(Converter::ASSET_INFO_MAGIC, sinfos);
+    if (!tile_flips.empty()) {
+        bundle_p->add(Converter::TILE_FLIP_MAGIC, tile_flips);
+    }
+}
+
+void read_asset_infos(const AssetBundle& bundle, std::vector<AssetInfo> * infos_p) {
+    // raw sections are used in place, only the (small) per-asset index lists are copied into AssetInfo
+    // (compressed sections are inflated into these first)
+    std::vector<uint8_t> tile_index_storage;
+    std::vector<uint8_t> tile_flip_storage;
+    std::vector<StoredAssetInfo> sinfo_storage;
+    ChunkView<uint8_t> tile_flips;
+    if (bundle.has_section(Converter::TILE_FLIP_MAGIC)) {
+        tile_flips = bundle.read_section(Converter::TILE_FLIP_MAGIC, &tile_flip_storage);
+    }
 
-void parse(const std::string& png_dir_name) {
-    parse_pngs(png_dir_name);
+    load_asset_infos(bundle.read_section(Converter::TILE_IDX_MAGIC, &tile_index_storage), tile_flips,
+                     bundle.read_section(Converter::ASSET_INFO_MAGIC, &sinfo_storage), infos_p);
+}
 
-    // write tile chunk
-    std::ofstream tile_file(data_path(Converter::TILE_CHUNK_FILE), std::ios::binary);
-    write_chunk(Converter::TILE_MAGIC, tiles, &tile_file);
-    tile_file.close();
-    std::cout<<"Tile data output to "<<data_path(Converter::TILE_CHUNK_FILE)<<std::endl;
+void parse(const std::string& png_dir_name, const ConvertOptions& options) {
+    parse_pngs(png_dir_name, options);
 
-    // write palette chunk
-    std::ofstream palette_file(data_path(Converter::PALETTE_CHUNK_FILE), std::ios::binary);
-    write_chunk(Converter::PALETTE_MAGIC, palettes, &palette_file);
-    palette_file.close();
-    std::cout<<"Palette data output to "<<data_path(Converter::PALETTE_CHUNK_FILE)<<std::endl;
+    // the bundle is built in memory, and only rewritten if its contents change
+    AssetBundleWriter bundle_writer;
+    bundle_writer.compression_level = options.compression_level;
+    bundle_writer.add(Converter::TILE_MAGIC, tiles);
+    bundle_writer.add(Converter::PALETTE_MAGIC, palettes);
+    add_asset_infos(asset_infos, &bundle_writer);
 
-    // write AssetInfo chunk
-    std::ofstream asset_info_file(data_path(Converter::ASSET_INFO_CHUNK_FILE), std::ios::binary);
-    write_asset_info_chunk(asset_infos, &asset_info_file);
-    asset_info_file.close();
-    std::cout<<"AssetInfo data output to "<<data_path(Converter::ASSET_INFO_CHUNK_FILE)<<std::endl;
+    std::ostringstream bundle_data;
+    bundle_writer.write(&bundle_data);
+    std::string bundle_path = data_path(Converter::BUNDLE_FILE);
+    if (write_if_changed(bundle_path, bundle_data.str())) {
+        std::cout<<"Tile, palette and AssetInfo data output to "<<bundle_path<<std::endl;
+    } else {
+        std::cout<<"Tile, palette and AssetInfo data unchanged in "<<bundle_path<<std::endl;
+    }
 
 
-//    /** sample code of read chunk data
+//    /** sample code of read bundle data
+    AssetBundle bundle(bundle_path);
     // read tile
-    std::vector<PPU466::Tile> converted_tiles{};
-    std::ifstream source_tile_file(data_path(Converter::TILE_CHUNK_FILE), std::ios::binary);
-    read_chunk(source_tile_file, Converter::TILE_MAGIC, &converted_tiles);
+    std::vector<PPU466::Tile> tile_storage;
+    ChunkView<PPU466::Tile> converted_tiles = bundle.read_section(Converter::TILE_MAGIC, &tile_storage);
 
     // read palette
-    std::vector<PPU466::Palette> converted_palettes{};
-    std::ifstream source_palette_file(data_path(Converter::PALETTE_CHUNK_FILE), std::ios::binary);
-    read_chunk(source_palette_file, Converter::PALETTE_MAGIC, &converted_palettes);
+    std::vector<PPU466::Palette> palette_storage;
+    ChunkView<PPU466::Palette> converted_palettes = bundle.read_section(Converter::PALETTE_MAGIC, &palette_storage);
 
     // read asset info
     std::vector<AssetInfo> converted_asset_infos{};
-    std::ifstream source_asset_info_file(data_path(Converter::ASSET_INFO_CHUNK_FILE), std::ios::binary);
-    read_asset_info_chunk(source_asset_info_file, &converted_asset_infos);
+    read_asset_infos(bundle, &converted_asset_infos);
 //    **/
+    (void)converted_tiles; (void)converted_palettes; // (only used by the asserts below)
 
     // debug: check if is the same
-    assert(tiles.size() == converted_tiles.size());
+    assert(tiles.size() == converted_tiles.size);
     for (size_t i=0; i<tiles.size(); i++) {
         assert(tiles[i].bit0 == converted_tiles[i].bit0);
         assert(tiles[i].bit1 == converted_tiles[i].bit1);
     }
     std::cout<<"Tiles check pass!\n";
 
-    assert(palettes.size() == converted_palettes.size());
+    assert(palettes.size() == converted_palettes.size);
     for (size_t i=0; i<palettes.size(); i++) {
         assert(palettes[i] == converted_palettes[i]);
     }
@@ -395,6 +1090,7 @@ void parse(const std::string& png_dir_name) {
     assert(converted_asset_infos.size() == asset_infos.size());
     for(size_t i=0; i<asset_infos.size(); i++) {
         assert(asset_infos[i].tile_indices == converted_asset_infos[i].tile_indices);
+        assert(asset_infos[i].tile_flips == converted_asset_infos[i].tile_flips);
         assert(asset_infos[i].palette_index == converted_asset_infos[i].palette_index);
         assert(asset_infos[i].width == converted_asset_infos[i].width);
         assert(asset_infos[i].height == converted_asset_infos[i].height);
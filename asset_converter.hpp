@@ -3,6 +3,7 @@
 //
 
 #include "PPU466.hpp"
+#include "asset_bundle.hpp"
 #include <vector>
 #include <string>
 
@@ -11,35 +12,49 @@
 
 /**
  * Layout of asset data:
- * 3 chunk files:
- *    (1) for all tile data
- *    (2) for all palette data
- *    (3) for all character info data (placement of tile, palette, width, height, etc)
+ * one bundle file (see asset_bundle.hpp), which the game maps into memory, with sections:
+ *    (1) for all tile data ("tile")
+ *    (2) for all palette data ("pale")
+ *    (3) for all character info data (placement of tile, palette, width, height, etc: "tidx", "aset", optional "tflp")
+ * (3) can also be written as a stream of chunks (write_asset_info_chunk / read_asset_info_chunk)
  */
 
 namespace Converter {
     const std::string DATA_DIR = "data/"; //directory name of data
     const std::string CHUNK_POSTFIX = ".chunk";
-    const std::string TILE_CHUNK_FILE = DATA_DIR + "tiles" + CHUNK_POSTFIX;
-    const std::string PALETTE_CHUNK_FILE = DATA_DIR + "palettes" + CHUNK_POSTFIX;
-    const std::string ASSET_INFO_CHUNK_FILE = DATA_DIR + "asset_infos" + CHUNK_POSTFIX;
+    const std::string BUNDLE_FILE = DATA_DIR + "assets.bundle";
+    // converter-only cache for incremental conversion (not read by the game)
+    const std::string MANIFEST_FILE = DATA_DIR + "converter_manifest" + CHUNK_POSTFIX;
 
     /* Magic string for different data chunk */
     const std::string TILE_MAGIC = "tile";
     const std::string PALETTE_MAGIC = "pale";
     const std::string ASSET_INFO_MAGIC = "aset";
     const std::string TILE_IDX_MAGIC = "tidx";
+    const std::string TILE_FLIP_MAGIC = "tflp"; // only written when some tile is stored as a mirror of another
+
+    /* Magic strings of the manifest's chunks */
+    const std::string MANIFEST_VERSION_MAGIC = "mver";
+    const std::string MANIFEST_NAME_MAGIC = "mnam";
+    const std::string MANIFEST_ENTRY_MAGIC = "ment";
+    const std::string MANIFEST_TILE_MAGIC = "mtil";
 }
 
 struct AssetInfo {
     // a list of indices into tile table, the lower left 8*8 is the first one
     std::vector<uint8_t> tile_indices;
+    // flip bits (PPU466::FlipX / PPU466::FlipY) for each entry of tile_indices,
+    // empty if no tile of this asset is drawn mirrored
+    std::vector<uint8_t> tile_flips;
     // each asset(png) will only use one palette
     uint8_t palette_index;
     // (width/8) * (height/8) tiles to form this character,
     // width*height/64 == tile_indices.size()
     uint8_t width;
     uint8_t height;
+
+    // flip bits of the i-th tile, in sprite attribute layout (shift left by 8 for a background entry)
+    uint8_t tile_flip(size_t i) const { return tile_flips.empty() ? 0 : tile_flips[i]; }
 };
 
 struct StoredAssetInfo {
@@ -50,10 +65,70 @@ struct StoredAssetInfo {
     uint32_t height;
 };
 
-// used for game to read chunk
+// used for game to read the asset info sections of a bundle
+void read_asset_infos(const AssetBundle& bundle, std::vector<AssetInfo> * infos_p);
+void add_asset_infos(const std::vector<AssetInfo>& infos, AssetBundleWriter * bundle_p);
+
+// the same data as a stream of chunks ("aset", "tidx", optional "tflp")
 void read_asset_info_chunk(std::istream & from, std::vector<AssetInfo> * infos_p);
+// ...or viewed in place in a buffer holding those chunks (see view_chunk in read_write_chunk.hpp)
+void read_asset_info_chunk(const void *data, size_t size, std::vector<AssetInfo> * infos_p);
+void write_asset_info_chunk(const std::vector<AssetInfo>& infos, std::ostream *to_);
+
+/**
+ * Incremental conversion:
+ * the manifest records, for every source png, a hash of the file's contents and what decoding it produced
+ * (its size, its own palette and its tiles in that palette). A png whose hash matches is not decoded again.
+ * Palette and tile indices are still assigned over all assets, so the output is the same as a full conversion.
+ */
+struct StoredManifestEntry {
+    uint64_t content_hash;
+    uint32_t name_begin; // range in the name chunk
+    uint32_t name_end;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_begin; // range in the manifest's tile chunk
+    uint32_t tile_end;
+    PPU466::Palette palette;
+};
+static_assert(sizeof(StoredManifestEntry) == 48, "StoredManifestEntry is packed");
+
+struct ConvertOptions {
+    // print progress
+    bool verbose = true;
+    // store a tile that is a horizontal/vertical mirror of an existing tile as a reference
+    // to that tile plus flip bits (AssetInfo::tile_flips) instead of a new tile
+    bool reuse_mirrored_tiles = false;
+    // choose palettes by looking at every png's colors together (fewest palettes, then most shared tiles)
+    // instead of giving each png, in asset order, the first palette that holds its colors
+    bool pack_palettes = false;
+    // if not empty, the manifest is read from (when incremental is set) and written to this file
+    std::string manifest_path;
+    // skip decoding pngs that haven't changed since the manifest was written
+    bool incremental = true;
+    // zlib level (1 fastest ... 9 smallest) for large bundle sections and the manifest's tiles, 0 stores them raw
+    // (see AssetBundleWriter::compress_min_size; sections under it stay raw so the game can use them in place)
+    int compression_level = 6;
+    // the pngs to convert (file names without ".png"), in asset order; empty converts the game's own assets
+    std::vector<std::string> asset_names;
+};
 
 // used for converter_runner to parse .png and convert to chunk
-void parse(const std::string& png_dir_name);
+// (chunk files whose contents would not change are not rewritten)
+void parse(const std::string& png_dir_name, const ConvertOptions& options = ConvertOptions());
+
+// convert the .png files into the converter's tile, palette and asset info tables (without writing any chunk),
+// the tables are cleared first, so this can be called repeatedly (e.g. by benchmarks)
+void parse_pngs(const std::string& png_dir_name, const ConvertOptions& options = ConvertOptions());
+
+// sizes of the tables built by the last parse_pngs
+// (tile_references counts the tiles of every asset, so tile_references / tiles is how well tiles were shared)
+struct ConvertStats {
+    size_t assets = 0;
+    size_t palettes = 0;
+    size_t tiles = 0;
+    size_t tile_references = 0;
+};
+ConvertStats convert_stats();
 
 #endif //INC_15_466_F20_BASE1_ASSET_CONVERTER_H
@@ -3,13 +3,42 @@
 //
 
 #include "asset_converter.hpp"
+#include "data_path.hpp"
+#include <cstdlib>
 #include <iostream>
+#include <string>
 
 int main(int argc, char**argv) {
-    if(argc != 2) {
+    // usage: converter_runner [--mirror] [--pack] [--full] [--compress <level>] <path-to-png-directory>
+    ConvertOptions options;
+    options.manifest_path = data_path(Converter::MANIFEST_FILE);
+    int argi = 1;
+    for (; argi < argc && std::string(argv[argi]).substr(0, 2) == "--"; argi++) {
+        std::string arg = argv[argi];
+        if (arg == "--mirror") {
+            options.reuse_mirrored_tiles = true;
+        } else if (arg == "--pack") {
+            options.pack_palettes = true;
+        } else if (arg == "--full") {
+            options.incremental = false;
+        } else if (arg == "--compress" && argi + 1 < argc) {
+            options.compression_level = std::atoi(argv[++argi]);
+            if (options.compression_level < 0 || options.compression_level > 9) {
+                std::cout<<"--compress takes a zlib level from 0 (raw) to 9 (smallest)"<<std::endl;
+                return 1;
+            }
+        } else {
+            std::cout<<"Unknown option "<<arg<<std::endl;
+            return 1;
+        }
+    }
+    if(argc - argi != 1) {
         std::cout<<"Provide <path-to-png-directory> as the first argument"<<std::endl;
+        std::cout<<"(pass --mirror before it to store mirrored duplicate tiles as flipped references,"<<std::endl;
+        std::cout<<" --pack to choose palettes for all pngs together (fewer palettes and tiles),"<<std::endl;
+        std::cout<<" --full to decode every png even if the manifest says it is unchanged,"<<std::endl;
+        std::cout<<" and --compress <level> to set the zlib level for large outputs, 0 for none; default 6)"<<std::endl;
         return 0;
     }
-    parse(argv[1]);
+    parse(argv[argi], options);
 }
-
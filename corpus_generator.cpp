@@ -0,0 +1,190 @@
+#include "load_save_png.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Writes a synthetic, reproducible corpus of pngs for benchmarking the asset converter
+ * (ppu_bench --corpus <dir>), much larger than source_png/:
+ *    - 'pngs' small sprites (1..4 by 1..4 tiles) and 'sheets' large sprite sheets,
+ *    - every tile is one of 'patterns' random 8*8 patterns, drawn (with probability 'mirror_rate') mirrored,
+ *    - every png uses one of 'palettes' palettes, and all four of its colors (transparent + 3),
+ * so the corpus has lots of duplicate and mirrored tiles but still fits the PPU's tables once deduplicated:
+ * at most patterns*palettes*4 tiles (patterns*palettes when the converter reuses mirrored tiles).
+ * The png names, in asset order, are listed in corpus.txt.
+ */
+struct CorpusOptions {
+    uint32_t seed = 1;
+    uint32_t pngs = 2000;
+    uint32_t sheets = 4;
+    uint32_t sheet_tiles = 31; // tiles along each side of a sheet (AssetInfo stores sizes in a byte, so at most 31)
+    uint32_t palettes = 8;
+    uint32_t patterns = 8;
+    double mirror_rate = 0.5;
+};
+
+static const int TILE_SIZE = 8;
+static const uint32_t MAX_PPU_TILES = 256;
+static const uint32_t MAX_PPU_PALETTES = 8;
+
+// 8*8 palette indices, row by row
+typedef std::vector<uint8_t> Pattern;
+
+/**
+ * Everything is drawn straight from mt19937 (not std::*_distribution, which differ between standard libraries),
+ * so the same seed gives the same corpus everywhere
+ */
+struct CorpusRandom {
+    explicit CorpusRandom(uint32_t seed) : mt(seed) { }
+    uint32_t below(uint32_t n) { return uint32_t(mt() % n); }
+    double unit() { return mt() / 4294967296.0; }
+    std::mt19937 mt;
+};
+
+static Pattern random_pattern(CorpusRandom& random) {
+    Pattern pattern(TILE_SIZE * TILE_SIZE);
+    for (auto& idx: pattern) {
+        idx = uint8_t(random.below(4));
+    }
+    // make sure every index is used (on the diagonal), so every png has all four colors of its palette
+    for (uint8_t idx = 0; idx < 4; idx++) {
+        pattern[idx * (TILE_SIZE + 1)] = idx;
+    }
+    return pattern;
+}
+
+/**
+ * Draw a png of cols*rows tiles, every tile a (possibly mirrored) pattern in the given colors
+ */
+static std::vector<glm::u8vec4> random_png(CorpusRandom& random, const CorpusOptions& options,
+                                           const std::vector<Pattern>& patterns, const glm::u8vec4 (&colors)[4],
+                                           uint32_t cols, uint32_t rows) {
+    uint32_t width = cols * TILE_SIZE;
+    std::vector<glm::u8vec4> data(size_t(width) * rows * TILE_SIZE);
+    for (uint32_t i = 0; i < rows; i++) {
+        for (uint32_t j = 0; j < cols; j++) {
+            const Pattern& pattern = patterns[random.below(uint32_t(patterns.size()))];
+            bool flip_x = false;
+            bool flip_y = false;
+            if (random.unit() < options.mirror_rate) {
+                uint32_t flips = 1 + random.below(3); // x, y or both
+                flip_x = (flips & 1) != 0;
+                flip_y = (flips & 2) != 0;
+            }
+            for (int y = 0; y < TILE_SIZE; y++) {
+                for (int x = 0; x < TILE_SIZE; x++) {
+                    int px = flip_x ? TILE_SIZE - 1 - x : x;
+                    int py = flip_y ? TILE_SIZE - 1 - y : y;
+                    data[size_t(i * TILE_SIZE + y) * width + j * TILE_SIZE + x] = colors[pattern[py * TILE_SIZE + px]];
+                }
+            }
+        }
+    }
+    return data;
+}
+
+static void generate_corpus(const std::string& out_dir, const CorpusOptions& options) {
+    CorpusRandom random(options.seed);
+
+    std::vector<Pattern> patterns;
+    for (uint32_t i = 0; i < options.patterns; i++) {
+        patterns.push_back(random_pattern(random));
+    }
+    // three distinct opaque colors per palette (distinct across palettes too, so no palette holds another's colors)
+    std::vector<uint32_t> used_colors;
+    std::vector<std::array<glm::u8vec4, 4>> palettes(options.palettes);
+    for (auto& palette: palettes) {
+        palette[0] = glm::u8vec4(0, 0, 0, 0);
+        for (int c = 1; c < 4; c++) {
+            uint32_t rgb;
+            do {
+                rgb = random.below(1u << 24);
+            } while (std::find(used_colors.begin(), used_colors.end(), rgb) != used_colors.end());
+            used_colors.push_back(rgb);
+            palette[c] = glm::u8vec4(rgb & 0xff, (rgb >> 8) & 0xff, rgb >> 16, 0xff);
+        }
+    }
+
+    std::ofstream list(out_dir + "/corpus.txt");
+    if (!list) {
+        throw std::runtime_error("Failed to write '" + out_dir + "/corpus.txt' (does the directory exist?)");
+    }
+    auto write_png = [&](const std::string& name, uint32_t cols, uint32_t rows) {
+        const auto& palette = palettes[random.below(options.palettes)];
+        glm::u8vec4 colors[4] = {palette[0], palette[1], palette[2], palette[3]};
+        std::vector<glm::u8vec4> data = random_png(random, options, patterns, colors, cols, rows);
+        save_png(out_dir + "/" + name + ".png", glm::uvec2(cols * TILE_SIZE, rows * TILE_SIZE), data.data(), LowerLeftOrigin);
+        list<<name<<"\n";
+    };
+    for (uint32_t i = 0; i < options.pngs; i++) {
+        std::ostringstream name;
+        name<<"sprite_"<<std::setw(5)<<std::setfill('0')<<i;
+        write_png(name.str(), 1 + random.below(4), 1 + random.below(4));
+    }
+    for (uint32_t i = 0; i < options.sheets; i++) {
+        std::ostringstream name;
+        name<<"sheet_"<<std::setw(3)<<std::setfill('0')<<i;
+        write_png(name.str(), options.sheet_tiles, options.sheet_tiles);
+    }
+}
+
+int main(int argc, char**argv) {
+    // usage: corpus_generator [--seed S] [--pngs N] [--sheets N] [--sheet-tiles N] [--palettes N] [--patterns N]
+    //                         [--mirror-rate R] <output-directory>
+    CorpusOptions options;
+    int argi = 1;
+    for (; argi + 1 < argc && std::string(argv[argi]).substr(0, 2) == "--"; argi += 2) {
+        std::string arg = argv[argi];
+        const char *value = argv[argi + 1];
+        if (arg == "--seed") {
+            options.seed = uint32_t(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--pngs") {
+            options.pngs = uint32_t(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--sheets") {
+            options.sheets = uint32_t(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--sheet-tiles") {
+            options.sheet_tiles = uint32_t(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--palettes") {
+            options.palettes = uint32_t(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--patterns") {
+            options.patterns = uint32_t(std::strtoul(value, nullptr, 10));
+        } else if (arg == "--mirror-rate") {
+            options.mirror_rate = std::strtod(value, nullptr);
+        } else {
+            std::cout<<"Unknown option "<<arg<<std::endl;
+            return 1;
+        }
+    }
+    if (argc - argi != 1) {
+        std::cout<<"Usage: corpus_generator [--seed S] [--pngs N] [--sheets N] [--sheet-tiles N] [--palettes N]"<<std::endl;
+        std::cout<<"                        [--patterns N] [--mirror-rate R] <output-directory>"<<std::endl;
+        std::cout<<"(writes pngs and corpus.txt into the existing <output-directory>; run ppu_bench --corpus on it)"<<std::endl;
+        return 0;
+    }
+    if (options.palettes < 1 || options.patterns < 1 || options.sheet_tiles < 1 || options.sheet_tiles > 31) {
+        std::cout<<"Need at least one palette and pattern, and 1 to 31 tiles per sheet side"<<std::endl;
+        return 1;
+    }
+
+    generate_corpus(argv[argi], options);
+
+    uint32_t max_tiles = options.patterns * options.palettes * 4;
+    std::cout<<"Wrote "<<options.pngs<<" sprites and "<<options.sheets<<" sheets ("
+             <<(options.pngs + options.sheets)<<" pngs) to "<<argv[argi]<<std::endl;
+    std::cout<<"At most "<<max_tiles<<" distinct tiles ("<<(max_tiles / 4)<<" reusing mirrored tiles) in "
+             <<options.palettes<<" palettes"<<std::endl;
+    if (options.palettes > MAX_PPU_PALETTES || max_tiles / 4 > MAX_PPU_TILES) {
+        std::cout<<"(more than the PPU holds, so the converter will run out of palettes or tiles)"<<std::endl;
+    } else if (max_tiles > MAX_PPU_TILES) {
+        std::cout<<"(may be more tiles than the PPU holds unless the converter reuses mirrored tiles)"<<std::endl;
+    }
+}
@@ -0,0 +1,111 @@
+#include "gl_errors.hpp"
+
+#include <SDL.h>
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+//debug output isn't part of the GL 3.3 core headers in GL.hpp, so declare the pieces used here:
+#ifndef GL_DEBUG_OUTPUT
+	#define GL_DEBUG_OUTPUT                   0x92E0
+	#define GL_DEBUG_TYPE_ERROR               0x824C
+	#define GL_DEBUG_SEVERITY_HIGH            0x9146
+	#define GL_DEBUG_SEVERITY_MEDIUM          0x9147
+	#define GL_DEBUG_SEVERITY_LOW             0x9148
+	#define GL_DEBUG_SEVERITY_NOTIFICATION    0x826B
+#endif
+typedef void (APIENTRY *GLDebugProc)(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, GLchar const *message, void const *userParam);
+typedef void (APIENTRY *GLDebugMessageCallbackProc)(GLDebugProc callback, void const *userParam);
+
+namespace {
+	//set once debug output is installed; GL_ERRORS() stops polling after that:
+	bool use_debug_output = false;
+
+	//most recent GL_ERRORS() location (the callback may run on a driver thread, hence atomic):
+	std::atomic< char const * > last_where(nullptr);
+
+	//how many times each message has been seen (keyed by source, type, and id -- plus the text, since some drivers reuse ids):
+	std::mutex seen_mutex;
+	std::unordered_map< std::string, uint64_t > seen;
+
+	//'where' is the GL_ERRORS() location that found the error (polling) or the last one before it (debug output):
+	void report(char const *what, std::string const &message, char const *where, uint64_t count) {
+		std::cerr << "WARNING: " << what << " '" << message << "'";
+		if (where) std::cerr << (use_debug_output ? " (after " : " at ") << where << (use_debug_output ? ")" : "");
+		if (count > 1) std::cerr << " [seen " << count << " times]";
+		std::cerr << std::endl;
+	}
+
+	//print a message the 1st, 2nd, 4th, 8th, ... time it is seen:
+	void report_deduplicated(char const *what, std::string const &key, std::string const &message, char const *where) {
+		uint64_t count;
+		{
+			std::lock_guard< std::mutex > lock(seen_mutex);
+			count = ++seen[key];
+		}
+		if ((count & (count - 1)) == 0) report(what, message, where, count);
+	}
+
+	#if GL_ERRORS_ENABLED
+	void APIENTRY debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, GLchar const *message, void const *) {
+		//skip chatter (e.g., "buffer will use video memory") but keep anything that suggests a problem:
+		if (type != GL_DEBUG_TYPE_ERROR && (severity == GL_DEBUG_SEVERITY_NOTIFICATION || severity == GL_DEBUG_SEVERITY_LOW)) return;
+
+		std::string text = (length < 0 ? std::string(message) : std::string(message, length));
+		std::string key = std::to_string(source) + ":" + std::to_string(type) + ":" + std::to_string(id) + ":" + text;
+		report_deduplicated(type == GL_DEBUG_TYPE_ERROR ? "gl error" : "gl debug message", key, text, last_where.load());
+	}
+	#endif
+}
+
+bool gl_errors_use_debug_output() {
+	#if GL_ERRORS_ENABLED
+	GLDebugMessageCallbackProc callback = nullptr;
+	if (SDL_GL_ExtensionSupported("GL_KHR_debug")) {
+		callback = (GLDebugMessageCallbackProc)SDL_GL_GetProcAddress("glDebugMessageCallback");
+	} else if (SDL_GL_ExtensionSupported("GL_ARB_debug_output")) {
+		callback = (GLDebugMessageCallbackProc)SDL_GL_GetProcAddress("glDebugMessageCallbackARB");
+	}
+	if (!callback) return false;
+
+	//anything already in the error queue would otherwise never be reported:
+	gl_errors("before gl_errors_use_debug_output()");
+
+	callback(debug_callback, nullptr);
+	glEnable(GL_DEBUG_OUTPUT); //(always on in debug contexts; needed for KHR_debug in others)
+	glGetError(); //(ARB_debug_output doesn't know GL_DEBUG_OUTPUT; don't leave that error behind)
+	use_debug_output = true;
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+void gl_errors(char const *where) {
+	if (use_debug_output) {
+		last_where.store(where);
+		return;
+	}
+
+	GLenum err = 0;
+	while ((err = glGetError()) != GL_NO_ERROR) {
+		char const *name = nullptr;
+		#define CHECK( ERR ) \
+			if (err == ERR) name = #ERR;
+
+		CHECK( GL_INVALID_ENUM )
+		CHECK( GL_INVALID_VALUE )
+		CHECK( GL_INVALID_OPERATION )
+		CHECK( GL_INVALID_FRAMEBUFFER_OPERATION )
+		CHECK( GL_OUT_OF_MEMORY )
+		CHECK( GL_STACK_UNDERFLOW )
+		CHECK( GL_STACK_OVERFLOW )
+		#undef CHECK
+
+		std::string message = (name ? std::string(name) : std::to_string(err));
+		report_deduplicated("gl error", message + " at " + where, message, where);
+	}
+}
@@ -1,31 +1,43 @@
 #pragma once
 
+/*
+ * GL error reporting.
+ *
+ * GL_ERRORS() reports OpenGL errors along with the file and line it was called from.
+ *
+ * If gl_errors_use_debug_output() has been called and the context supports debug output
+ *  (GL 4.3, KHR_debug, or ARB_debug_output -- main.cpp asks for a debug context),
+ *  the driver reports errors through a callback as they happen, and GL_ERRORS() just records
+ *  its location (so messages can say where they happened near) instead of polling glGetError,
+ *  which can make the CPU wait for the GPU on some drivers.
+ * Repeated messages are only printed the 1st, 2nd, 4th, 8th, ... time they happen.
+ *
+ * GL_ERRORS() compiles to nothing unless GL_ERRORS_ENABLED is nonzero;
+ *  by default it is enabled, except in builds that define NDEBUG.
+ */
+
 #include "GL.hpp"
-#include <iostream>
+
+#ifndef GL_ERRORS_ENABLED
+	#ifdef NDEBUG
+		#define GL_ERRORS_ENABLED 0
+	#else
+		#define GL_ERRORS_ENABLED 1
+	#endif
+#endif
 
 #define STR2(X) # X
 #define STR(X) STR2(X)
 
-inline void gl_errors(std::string const &where) {
-	GLenum err = 0;
-	while ((err = glGetError()) != GL_NO_ERROR) {
-		#define CHECK( ERR ) \
-			if (err == ERR) { \
-				std::cerr << "WARNING: gl error '" #ERR "' at " << where << std::endl; \
-			} else
+//try to switch to callback-based reporting; returns false (and keeps polling) if debug output isn't available:
+// (call once, after the OpenGL context is created)
+bool gl_errors_use_debug_output();
 
-		CHECK( GL_INVALID_ENUM )
-		CHECK( GL_INVALID_VALUE )
-		CHECK( GL_INVALID_OPERATION )
-		CHECK( GL_INVALID_FRAMEBUFFER_OPERATION )
-		CHECK( GL_OUT_OF_MEMORY )
-		CHECK( GL_STACK_UNDERFLOW )
-		CHECK( GL_STACK_OVERFLOW )
-		{
-			std::cerr << "WARNING: gl error '" << err << "'" << std::endl;
-		}
-		#undef CHECK
-	}
-}
-#define GL_ERRORS() gl_errors(__FILE__  ":" STR(__LINE__) )
+//check for (or, with debug output, note the location for) errors; 'where' should be a string literal:
+void gl_errors(char const *where);
 
+#if GL_ERRORS_ENABLED
+	#define GL_ERRORS() gl_errors(__FILE__  ":" STR(__LINE__) )
+#else
+	#define GL_ERRORS() ((void)0)
+#endif
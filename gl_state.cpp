@@ -0,0 +1,180 @@
+#include "gl_state.hpp"
+
+GLState gl_state;
+
+void GLState::forget() {
+	active_unit = Unknown;
+	texture_2d.fill(Unknown);
+	program = Unknown;
+	vertex_array = Unknown;
+	array_buffer = Unknown;
+	draw_framebuffer = Unknown;
+	read_framebuffer = Unknown;
+	viewport_known = false;
+	clear_color_known = false;
+	caps.fill(2);
+	blend_equation_mode = Unknown;
+	blend_sfactor = blend_dfactor = Unknown;
+}
+
+//helper: update 'cached' to 'value'; returns true if a GL call is needed:
+template< typename T >
+static bool change(GLState::Counters &counters, T &cached, T value) {
+	if (cached == value) {
+		counters.skipped += 1;
+		return false;
+	}
+	cached = value;
+	counters.issued += 1;
+	return true;
+}
+
+void GLState::active_texture(GLenum unit) {
+	if (change(counters, active_unit, unit)) glActiveTexture(unit);
+}
+
+void GLState::bind_texture(GLenum target, GLuint texture) {
+	uint32_t index = active_unit - GL_TEXTURE0;
+	if (target != GL_TEXTURE_2D || active_unit == Unknown || index >= MaxTextureUnits) {
+		counters.issued += 1;
+		glBindTexture(target, texture);
+		return;
+	}
+	if (change(counters, texture_2d[index], texture)) glBindTexture(target, texture);
+}
+
+void GLState::use_program(GLuint program_) {
+	if (change(counters, program, program_)) glUseProgram(program_);
+}
+
+void GLState::bind_vertex_array(GLuint array) {
+	if (change(counters, vertex_array, array)) glBindVertexArray(array);
+}
+
+void GLState::bind_buffer(GLenum target, GLuint buffer) {
+	if (target != GL_ARRAY_BUFFER) {
+		counters.issued += 1;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (change(counters, array_buffer, buffer)) glBindBuffer(target, buffer);
+}
+
+void GLState::bind_framebuffer(GLenum target, GLuint framebuffer) {
+	if (target == GL_FRAMEBUFFER) {
+		if (draw_framebuffer == framebuffer && read_framebuffer == framebuffer) {
+			counters.skipped += 1;
+			return;
+		}
+		draw_framebuffer = read_framebuffer = framebuffer;
+		counters.issued += 1;
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	} else if (target == GL_DRAW_FRAMEBUFFER) {
+		if (change(counters, draw_framebuffer, framebuffer)) glBindFramebuffer(target, framebuffer);
+	} else if (target == GL_READ_FRAMEBUFFER) {
+		if (change(counters, read_framebuffer, framebuffer)) glBindFramebuffer(target, framebuffer);
+	} else {
+		counters.issued += 1;
+		glBindFramebuffer(target, framebuffer);
+	}
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	std::array< GLint, 4 > value{{ x, y, width, height }};
+	if (viewport_known && viewport_value == value) {
+		counters.skipped += 1;
+		return;
+	}
+	viewport_known = true;
+	viewport_value = value;
+	counters.issued += 1;
+	glViewport(x, y, width, height);
+}
+
+void GLState::clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+	std::array< GLfloat, 4 > value{{ r, g, b, a }};
+	if (clear_color_known && clear_color_value == value) {
+		counters.skipped += 1;
+		return;
+	}
+	clear_color_known = true;
+	clear_color_value = value;
+	counters.issued += 1;
+	glClearColor(r, g, b, a);
+}
+
+static uint32_t cap_index(GLenum cap) {
+	switch (cap) {
+		case GL_BLEND: return GLState::Blend;
+		case GL_DEPTH_TEST: return GLState::DepthTest;
+		case GL_CULL_FACE: return GLState::CullFace;
+		case GL_SCISSOR_TEST: return GLState::ScissorTest;
+		default: return GLState::CapCount;
+	}
+}
+
+void GLState::enable(GLenum cap) {
+	uint32_t index = cap_index(cap);
+	if (index == CapCount) {
+		counters.issued += 1;
+		glEnable(cap);
+		return;
+	}
+	if (change(counters, caps[index], uint8_t(1))) glEnable(cap);
+}
+
+void GLState::disable(GLenum cap) {
+	uint32_t index = cap_index(cap);
+	if (index == CapCount) {
+		counters.issued += 1;
+		glDisable(cap);
+		return;
+	}
+	if (change(counters, caps[index], uint8_t(0))) glDisable(cap);
+}
+
+void GLState::blend_equation(GLenum mode) {
+	if (change(counters, blend_equation_mode, mode)) glBlendEquation(mode);
+}
+
+void GLState::blend_func(GLenum sfactor, GLenum dfactor) {
+	if (blend_sfactor == sfactor && blend_dfactor == dfactor) {
+		counters.skipped += 1;
+		return;
+	}
+	blend_sfactor = sfactor;
+	blend_dfactor = dfactor;
+	counters.issued += 1;
+	glBlendFunc(sfactor, dfactor);
+}
+
+void GLState::get_viewport(GLint viewport_[4]) {
+	if (!viewport_known) {
+		glGetIntegerv(GL_VIEWPORT, viewport_value.data());
+		viewport_known = true;
+		counters.queries += 1;
+	}
+	for (uint32_t i = 0; i < 4; ++i) {
+		viewport_[i] = viewport_value[i];
+	}
+}
+
+GLuint GLState::get_draw_framebuffer() {
+	if (draw_framebuffer == Unknown) {
+		GLint value = 0;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &value);
+		draw_framebuffer = GLuint(value);
+		counters.queries += 1;
+	}
+	return draw_framebuffer;
+}
+
+GLuint GLState::get_read_framebuffer() {
+	if (read_framebuffer == Unknown) {
+		GLint value = 0;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &value);
+		read_framebuffer = GLuint(value);
+		counters.queries += 1;
+	}
+	return read_framebuffer;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ * GLState -- a small cache of OpenGL binding and fixed-function state.
+ *
+ * Calls made through gl_state (e.g., gl_state.use_program(p) instead of glUseProgram(p))
+ *  remember what they set and skip calls that wouldn't change anything.
+ * The cache also answers 'what is currently set?' (e.g., get_viewport()) without a synchronous glGet*.
+ *
+ * Only state changed through gl_state is tracked, so code that changes tracked state with direct
+ *  GL calls must call forget() afterward. Deleting a bound object also changes bindings, so call
+ *  forget() after glDelete* as well.
+ *
+ * Tracked state:
+ *  - active texture unit and GL_TEXTURE_2D bindings (units 0 to MaxTextureUnits-1)
+ *  - current program, vertex array, and GL_ARRAY_BUFFER binding
+ *  - draw and read framebuffer bindings
+ *  - viewport and clear color
+ *  - GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST; blend equation and function
+ * Other targets and capabilities are passed straight through to GL (and counted as issued).
+ */
+
+#include "GL.hpp"
+
+#include <array>
+#include <cstdint>
+
+struct GLState {
+	GLState() { forget(); }
+
+	//mark all state as unknown (the next call that sets each piece of state will always be issued):
+	void forget();
+
+	//--- setters (same arguments as the GL functions they replace) ---
+	void active_texture(GLenum unit);
+	void bind_texture(GLenum target, GLuint texture);
+	void use_program(GLuint program);
+	void bind_vertex_array(GLuint array);
+	void bind_buffer(GLenum target, GLuint buffer);
+	void bind_framebuffer(GLenum target, GLuint framebuffer);
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void clear_color(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void blend_equation(GLenum mode);
+	void blend_func(GLenum sfactor, GLenum dfactor);
+
+	//--- getters ---
+	//these return the cached value, and only query GL (once) if the value isn't known:
+	void get_viewport(GLint viewport[4]);
+	GLuint get_draw_framebuffer();
+	GLuint get_read_framebuffer();
+
+	//--- counters ---
+	//GL calls made (issued), avoided (skipped), and glGet* queries made by the getters above:
+	struct Counters {
+		uint64_t issued = 0;
+		uint64_t skipped = 0;
+		uint64_t queries = 0;
+	};
+	//counts since the last reset_counters() (main.cpp resets these every frame):
+	Counters counters;
+	//counts for the most recent complete frame:
+	Counters last_frame;
+	//moves 'counters' to 'last_frame' and starts counting again:
+	void reset_counters() { last_frame = counters; counters = Counters(); }
+
+	//------ internals ------
+	enum : uint32_t { MaxTextureUnits = 16 };
+	enum : GLuint { Unknown = -1U };
+
+	GLenum active_unit;
+	std::array< GLuint, MaxTextureUnits > texture_2d;
+	GLuint program;
+	GLuint vertex_array;
+	GLuint array_buffer;
+	GLuint draw_framebuffer;
+	GLuint read_framebuffer;
+
+	bool viewport_known;
+	std::array< GLint, 4 > viewport_value;
+	bool clear_color_known;
+	std::array< GLfloat, 4 > clear_color_value;
+
+	//tracked capabilities: 0 = disabled, 1 = enabled, 2 = unknown:
+	enum Cap : uint32_t { Blend, DepthTest, CullFace, ScissorTest, CapCount };
+	std::array< uint8_t, CapCount > caps;
+
+	GLenum blend_equation_mode;
+	GLenum blend_sfactor, blend_dfactor;
+};
+
+//the state of the (single) OpenGL context:
+extern GLState gl_state;
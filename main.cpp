@@ -10,18 +10,50 @@
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
+//for GL error reporting (and GL_ERRORS_ENABLED):
+#include "gl_errors.hpp"
+
+//GL state changes made here go through the state cache (which also counts GL calls per frame):
+#include "gl_state.hpp"
+
 //for screenshots:
 #include "load_save_png.hpp"
 
+//for timing the phases of the main loop:
+#include "FrameProfiler.hpp"
+
 //Includes for libSDL:
 #include <SDL.h>
 
 //...and for c++ standard library functions:
 #include <chrono>
 #include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <string>
+
+//Headless mode runs the game without a window or OpenGL context:
+// the current mode is updated with a fixed timestep and drawn with the software PPU.
+struct HeadlessOptions {
+	uint32_t frames = 0; //number of frames to run; 0 means "not headless"
+	float timestep = 1.0f / 60.0f; //seconds passed to each update
+	std::string hashes_file; //if not empty, write a hash of every frame here
+	std::string frames_prefix; //if not empty, save every frame as a .png with this prefix
+};
+
+static int run_headless(HeadlessOptions const &options);
+
+//The windowed main loop advances the current mode in fixed ticks:
+// real time accumulates, and 'update' is called once per whole tick,
+// at most max_ticks_per_frame times per frame (time beyond that is dropped to avoid a spiral of death).
+struct TimestepOptions {
+	float tick_rate = 60.0f; //simulation ticks per second
+	uint32_t max_ticks_per_frame = 5; //cap on catch-up ticks in a single frame
+};
 
 int main(int argc, char **argv) {
 #ifdef _WIN32
@@ -29,12 +61,55 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	//------------ command line ------------
+
+	HeadlessOptions headless;
+	TimestepOptions timestep;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		auto next_arg = [&]() -> std::string {
+			if (argi + 1 >= argc) throw std::runtime_error("Expected a value after '" + arg + "'.");
+			argi += 1;
+			return argv[argi];
+		};
+		if (arg == "--headless") {
+			headless.frames = uint32_t(std::stoul(next_arg()));
+		} else if (arg == "--timestep") {
+			headless.timestep = std::stof(next_arg());
+		} else if (arg == "--tick-rate") {
+			timestep.tick_rate = std::stof(next_arg());
+			if (!(timestep.tick_rate > 0.0f)) throw std::runtime_error("Tick rate must be positive.");
+		} else if (arg == "--max-ticks") {
+			timestep.max_ticks_per_frame = uint32_t(std::stoul(next_arg()));
+			if (timestep.max_ticks_per_frame == 0) throw std::runtime_error("Max ticks per frame must be at least 1.");
+		} else if (arg == "--hashes") {
+			headless.hashes_file = next_arg();
+		} else if (arg == "--frames") {
+			headless.frames_prefix = next_arg();
+		} else {
+			std::cerr << "Usage:\n"
+				"  " << argv[0] << " [--tick-rate <hz>] [--max-ticks <n>]\n"
+				"  " << argv[0] << " [--headless <frames> [--timestep <seconds>] [--hashes <file>] [--frames <prefix>]]\n"
+				"    --tick-rate <hz>      simulation ticks per second (default 60)\n"
+				"    --max-ticks <n>       most ticks run in one frame when catching up (default 5)\n"
+				"    --headless <frames>   run <frames> frames without a window, drawing with the software PPU\n"
+				"    --timestep <seconds>  time passed to each headless update (default 1/60)\n"
+				"    --hashes <file>       write a hash of every headless frame to <file>\n"
+				"    --frames <prefix>     save every headless frame to <prefix>NNNNN.png\n";
+			return 1;
+		}
+	}
+
+	if (headless.frames > 0) {
+		return run_headless(headless);
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
 	SDL_Init(SDL_INIT_VIDEO);
 
-	//Ask for an OpenGL context version 3.3, core profile, enable debug:
+	//Ask for an OpenGL context version 3.3, core profile, enable debug (unless GL error checking is compiled out):
 	SDL_GL_ResetAttributes();
 	SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
@@ -44,7 +119,9 @@ int main(int argc, char **argv) {
 	SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
 	SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+	#if GL_ERRORS_ENABLED
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG);
+	#endif
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 
@@ -78,6 +155,13 @@ int main(int argc, char **argv) {
 	//On windows, load OpenGL entrypoints: (does nothing on other platforms)
 	init_GL();
 
+	//Have the driver report GL errors as they happen (instead of GL_ERRORS() polling glGetError):
+	#if GL_ERRORS_ENABLED
+	if (!gl_errors_use_debug_output()) {
+		std::cerr << "NOTE: GL debug output isn't available; GL_ERRORS() will poll glGetError instead." << std::endl;
+	}
+	#endif
+
 	//Set VSYNC + Late Swap (prevents crazy FPS):
 	if (SDL_GL_SetSwapInterval(-1) != 0) {
 		std::cerr << "NOTE: couldn't set vsync + late swap tearing (" << SDL_GetError() << ")." << std::endl;
@@ -108,14 +192,23 @@ int main(int argc, char **argv) {
 		window_size = glm::uvec2(w, h);
 		SDL_GL_GetDrawableSize(window, &w, &h);
 		drawable_size = glm::uvec2(w, h);
-		glViewport(0, 0, drawable_size.x, drawable_size.y);
+		gl_state.viewport(0, 0, drawable_size.x, drawable_size.y);
 	};
 	on_resize();
 
+	//keeps track of how long each phase of each frame takes:
+	// (press F1 to print a report; a report is also printed at exit)
+	FrameProfiler profiler;
+
+	//seconds per simulation tick, and real time not yet simulated:
+	double const tick = 1.0 / double(timestep.tick_rate);
+	double accumulator = 0.0;
+
 	//This will loop until the current mode is set to null:
 	while (Mode::current) {
 		//every pass through the game loop creates one frame of output
 		//  by performing three steps:
+		profiler.begin_frame();
 
 		{ //(1) process any events that are pending
 			static SDL_Event evt;
@@ -134,7 +227,7 @@ int main(int argc, char **argv) {
 					// --- screenshot key ---
 					std::string filename = "screenshot.png";
 					std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
-					glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+					gl_state.bind_framebuffer(GL_READ_FRAMEBUFFER, 0);
 					glReadBuffer(GL_FRONT);
 					int w,h;
 					SDL_GL_GetDrawableSize(window, &w, &h);
@@ -144,34 +237,55 @@ int main(int argc, char **argv) {
 						px.a = 0xff;
 					}
 					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F1) {
+					// --- frame profile key ---
+					profiler.report(std::cout);
+					std::cout << "GL state calls last frame: " << gl_state.last_frame.issued << " issued, "
+						<< gl_state.last_frame.skipped << " skipped, " << gl_state.last_frame.queries << " queries." << std::endl;
 				}
 			}
 			if (!Mode::current) break;
 		}
+		profiler.end_phase(FrameProfiler::Events);
 
-		{ //(2) call the current mode's "update" function to deal with elapsed time:
+		{ //(2) call the current mode's "update" function once per elapsed tick:
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time;
-			float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
+			accumulator += std::chrono::duration< double >(current_time - previous_time).count();
 			previous_time = current_time;
 
-			//if frames are taking a very long time to process,
-			//lag to avoid spiral of death:
-			elapsed = std::min(0.1f, elapsed);
-
-			Mode::current->update(elapsed);
+			uint32_t ticks = 0;
+			while (accumulator >= tick && ticks < timestep.max_ticks_per_frame) {
+				Mode::current->update(float(tick));
+				accumulator -= tick;
+				ticks += 1;
+				if (!Mode::current) break;
+			}
 			if (!Mode::current) break;
+
+			//if frames are taking a very long time to process,
+			//lag (drop the time that couldn't be simulated) to avoid spiral of death:
+			accumulator = std::min(accumulator, tick);
 		}
+		profiler.end_phase(FrameProfiler::Update);
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
-			Mode::current->draw(drawable_size);
+			//blend factor between the previous and latest tick:
+			float alpha = float(std::min(1.0, accumulator / tick));
+			Mode::current->draw(drawable_size, alpha);
 		}
+		profiler.end_phase(FrameProfiler::Draw);
 
 		//Wait until the recently-drawn frame is shown before doing it all again:
 		SDL_GL_SwapWindow(window);
+		profiler.end_phase(FrameProfiler::Swap);
+
+		profiler.end_frame();
+		gl_state.reset_counters();
 	}
 
+	profiler.report(std::cout);
+
 
 	//------------  teardown ------------
 
@@ -193,3 +307,65 @@ int main(int argc, char **argv) {
 	}
 #endif
 }
+
+static int run_headless(HeadlessOptions const &options) {
+	//no OpenGL context, so 'call_load_functions()' is skipped and the PPU draws on the CPU:
+	static PPU466::Framebuffer framebuffer;
+	PPU466::headless_framebuffer = &framebuffer;
+
+	Mode::set_current(std::make_shared< PlayMode >());
+
+	std::ofstream hashes;
+	if (!options.hashes_file.empty()) {
+		hashes.open(options.hashes_file);
+		if (!hashes) {
+			std::cerr << "Failed to open '" << options.hashes_file << "' for writing." << std::endl;
+			return 1;
+		}
+	}
+
+	const glm::uvec2 drawable_size = glm::uvec2(PPU466::ScreenWidth, PPU466::ScreenHeight);
+
+	FrameProfiler profiler;
+	profiler.missed_frame_seconds = options.timestep;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	uint32_t frame = 0;
+	for (; frame < options.frames && Mode::current; ++frame) {
+		profiler.begin_frame();
+		Mode::current->update(options.timestep);
+		if (!Mode::current) break;
+		profiler.end_phase(FrameProfiler::Update);
+		Mode::current->draw(drawable_size, 1.0f); //one update per frame, so always draw the latest state
+		profiler.end_phase(FrameProfiler::Draw);
+		profiler.end_frame();
+
+		if (hashes.is_open()) {
+			//64-bit FNV-1a hash of the frame's pixels:
+			uint64_t hash = 0xcbf29ce484222325ULL;
+			for (auto const &px : framebuffer) {
+				for (uint32_t c = 0; c < 4; ++c) {
+					hash = (hash ^ px[c]) * 0x100000001b3ULL;
+				}
+			}
+			hashes << frame << ' ' << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << '\n';
+		}
+
+		if (!options.frames_prefix.empty()) {
+			std::ostringstream filename;
+			filename << options.frames_prefix << std::setw(5) << std::setfill('0') << frame << ".png";
+			save_png(filename.str(), drawable_size, framebuffer.data(), LowerLeftOrigin);
+		}
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	float seconds = std::chrono::duration< float >(end - start).count();
+	std::cout << "Ran " << frame << " headless frames in " << seconds << "s (" << (frame / std::max(seconds, 1e-6f)) << " frames/s)." << std::endl;
+	profiler.report(std::cout);
+
+	PPU466::headless_framebuffer = nullptr;
+	Mode::set_current(nullptr);
+
+	return 0;
+}
@@ -0,0 +1,490 @@
+//ppu_bench: microbenchmarks for the CPU-side hot paths of the PPU466 and the asset pipeline.
+//
+//Usage:
+//  ppu_bench [--filter <substring>] [--pngs <path-to-png-directory>] [--corpus <path-to-corpus-directory>]
+//
+//Before benchmarking, every tile codec usable on this CPU is checked against the scalar reference.
+//Each benchmark is run for a number of samples; each sample times enough operations to take ~2ms.
+//Reported numbers are per operation: mean / p50 / p95 / p99 / max time (over samples) and heap allocations.
+//
+//With --corpus (a directory written by corpus_generator), the converter is also run over that corpus,
+//reporting its throughput (pngs/s, tiles/s), how well tiles were shared, and the process's peak memory use.
+
+#include "PPU466.hpp"
+#include "tile_codec.hpp"
+#include "PlayMode.hpp"
+#include "asset_converter.hpp"
+#include "read_write_chunk.hpp"
+#include "data_path.hpp"
+
+#include <SDL.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//------------ allocation counting ------------
+//every heap allocation made through operator new is counted:
+
+static uint64_t allocation_count = 0;
+
+void *operator new(size_t size) {
+	allocation_count += 1;
+	if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+void operator delete(void *ptr, size_t) noexcept {
+	std::free(ptr);
+}
+
+//------------ benchmark harness ------------
+
+//results are written here so the compiler can't optimize away the work being timed:
+static volatile uint64_t sink = 0;
+
+static std::string filter;
+
+static void benchmark(std::string const &name, std::function< void() > const &op) {
+	if (name.find(filter) == std::string::npos) return;
+
+	typedef std::chrono::high_resolution_clock Clock;
+	constexpr uint32_t Samples = 50;
+	constexpr double SampleSeconds = 0.002;
+
+	//warm up and pick an iteration count so each sample takes about SampleSeconds:
+	uint32_t iterations = 1;
+	while (true) {
+		auto before = Clock::now();
+		for (uint32_t i = 0; i < iterations; ++i) op();
+		double seconds = std::chrono::duration< double >(Clock::now() - before).count();
+		if (seconds >= SampleSeconds || iterations >= (1U << 24)) break;
+		iterations *= 2;
+	}
+
+	std::vector< double > ns_per_op;
+	ns_per_op.reserve(Samples);
+	uint64_t allocations = 0;
+	for (uint32_t s = 0; s < Samples; ++s) {
+		uint64_t allocations_before = allocation_count;
+		auto before = Clock::now();
+		for (uint32_t i = 0; i < iterations; ++i) op();
+		auto after = Clock::now();
+		allocations += allocation_count - allocations_before;
+		ns_per_op.emplace_back(std::chrono::duration< double, std::nano >(after - before).count() / iterations);
+	}
+
+	double mean = 0.0;
+	for (double ns : ns_per_op) mean += ns;
+	mean /= ns_per_op.size();
+
+	std::sort(ns_per_op.begin(), ns_per_op.end());
+	auto percentile = [&](double p) {
+		return ns_per_op[std::min(ns_per_op.size() - 1, size_t(p * ns_per_op.size()))];
+	};
+
+	std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1)
+		<< std::setw(12) << mean
+		<< std::setw(12) << percentile(0.50)
+		<< std::setw(12) << percentile(0.95)
+		<< std::setw(12) << percentile(0.99)
+		<< std::setw(12) << ns_per_op.back()
+		<< std::setw(12) << std::setprecision(2) << double(allocations) / (double(Samples) * iterations)
+		<< std::endl;
+}
+
+//------------ converter throughput ------------
+
+//peak resident set size of this process so far, in bytes:
+static size_t peak_rss() {
+#if defined(_WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+	#if defined(__APPLE__)
+	return size_t(usage.ru_maxrss); //(bytes on macOS)
+	#else
+	return size_t(usage.ru_maxrss) * 1024; //(kilobytes on Linux)
+	#endif
+#endif
+}
+
+//run parse_pngs over a corpus_generator corpus in a few configurations, reporting throughput:
+static void corpus_throughput(std::string const &corpus_dir) {
+	ConvertOptions options;
+	options.verbose = false;
+	std::ifstream list(corpus_dir + "/corpus.txt");
+	for (std::string name; std::getline(list, name); ) {
+		if (!name.empty()) options.asset_names.emplace_back(name);
+	}
+	if (options.asset_names.empty()) {
+		std::cout << "(skipping corpus/: no corpus.txt in '" << corpus_dir << "'; write one with corpus_generator)" << std::endl;
+		return;
+	}
+
+	std::cout << "\n" << std::left << std::setw(36) << "corpus (" + std::to_string(options.asset_names.size()) + " pngs)" << std::right
+		<< std::setw(12) << "best ms" << std::setw(12) << "pngs/s" << std::setw(12) << "tiles/s"
+		<< std::setw(12) << "palettes" << std::setw(12) << "tiles" << std::setw(12) << "dedup" << std::endl;
+
+	auto run = [&](std::string const &name, ConvertOptions const &run_options) {
+		if (name.find(filter) == std::string::npos) return;
+		typedef std::chrono::high_resolution_clock Clock;
+		constexpr uint32_t Runs = 3;
+		double best = 0.0;
+		for (uint32_t r = 0; r < Runs; ++r) {
+			auto before = Clock::now();
+			try {
+				parse_pngs(corpus_dir, run_options);
+			} catch (std::runtime_error &e) {
+				std::cout << std::left << std::setw(36) << name << std::right << "  failed: " << e.what() << std::endl;
+				return;
+			}
+			double seconds = std::chrono::duration< double >(Clock::now() - before).count();
+			if (r == 0 || seconds < best) best = seconds;
+		}
+		//(tiles/s counts every tile of every png; dedup is how many of those each stored tile stands for)
+		ConvertStats stats = convert_stats();
+		std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(12) << best * 1000.0
+			<< std::setw(12) << stats.assets / best
+			<< std::setw(12) << stats.tile_references / best
+			<< std::setw(12) << stats.palettes
+			<< std::setw(12) << stats.tiles
+			<< std::setw(12) << std::setprecision(2) << (stats.tiles ? double(stats.tile_references) / stats.tiles : 0.0)
+			<< std::endl;
+	};
+
+	run("corpus/parse_pngs", options);
+	ConvertOptions mirror = options;
+	mirror.reuse_mirrored_tiles = true;
+	run("corpus/parse_pngs(mirror)", mirror);
+	ConvertOptions pack = options;
+	pack.pack_palettes = true;
+	run("corpus/parse_pngs(pack)", pack);
+	//(the first run writes the manifest, so every later run finds every png unchanged)
+	ConvertOptions incremental = options;
+	incremental.manifest_path = "ppu_bench_corpus_manifest.chunk";
+	run("corpus/parse_pngs(incremental)", incremental);
+	std::remove(incremental.manifest_path.c_str());
+
+	std::cout << "peak RSS: " << std::fixed << std::setprecision(1) << peak_rss() / (1024.0 * 1024.0) << " MiB" << std::endl;
+}
+
+//fill a PPU with random (but repeatable) tiles, palettes, background and sprites:
+template< typename PPU >
+static void randomize(PPU *ppu_) {
+	auto &ppu = *ppu_;
+	std::mt19937 mt(0x466);
+	for (auto &palette : ppu.palette_table) {
+		palette[0] = glm::u8vec4(0x00, 0x00, 0x00, 0x00);
+		for (uint32_t i = 1; i < 4; ++i) {
+			palette[i] = glm::u8vec4(uint8_t(mt()), uint8_t(mt()), uint8_t(mt()), 0xff);
+		}
+	}
+	for (auto &tile : ppu.tile_table) {
+		for (auto &b : tile.bit0) b = uint8_t(mt());
+		for (auto &b : tile.bit1) b = uint8_t(mt());
+	}
+	for (auto &entry : ppu.background) {
+		entry = uint16_t(mt() & 0x7fff);
+	}
+	for (auto &sprite : ppu.sprites) {
+		sprite.x = uint8_t(mt());
+		sprite.y = uint8_t(mt() % PPU::ScreenHeight);
+		sprite.index = uint8_t(mt());
+		sprite.attributes = uint8_t(mt());
+	}
+	ppu.background_position = glm::ivec2(37, -53);
+}
+
+//compare every tile codec against the scalar reference on random tiles (including all single-bit
+//patterns) at several strides; prints a report and returns false on any mismatch:
+static bool check_tile_codecs() {
+	std::vector< TileCodec > const &codecs = tile_codecs();
+	TileCodec const &reference = codecs[0];
+
+	std::vector< PPU466::Tile > tiles;
+	for (uint32_t b = 0; b < 128; ++b) {
+		PPU466::Tile tile;
+		tile.bit0.fill(0);
+		tile.bit1.fill(0);
+		(b < 64 ? tile.bit0 : tile.bit1)[(b % 64) / 8] = uint8_t(1 << (b % 8));
+		tiles.emplace_back(tile);
+	}
+	std::mt19937 mt(0x7113);
+	for (uint32_t i = 0; i < 1024; ++i) {
+		PPU466::Tile tile;
+		for (auto &b : tile.bit0) b = uint8_t(mt());
+		for (auto &b : tile.bit1) b = uint8_t(mt());
+		tiles.emplace_back(tile);
+	}
+
+	bool ok = true;
+	for (TileCodec const &codec : codecs) {
+		uint32_t mismatches = 0;
+		for (PPU466::Tile const &tile : tiles) {
+			for (size_t stride : {size_t(8), size_t(13), size_t(128)}) {
+				std::vector< uint8_t > expected(stride * 8, 0xee), got(stride * 8, 0xee);
+				reference.decode(tile, expected.data(), stride);
+				codec.decode(tile, got.data(), stride);
+				if (got != expected) mismatches += 1;
+			}
+			uint8_t indices[64];
+			reference.decode(tile, indices, 8);
+			PPU466::Tile encoded = codec.encode(indices);
+			if (encoded.bit0 != tile.bit0 || encoded.bit1 != tile.bit1) mismatches += 1;
+		}
+		std::cout << "tile codec " << codec.name << (&codec == &tile_codec() ? " (in use)" : "") << ": ";
+		if (mismatches == 0) {
+			std::cout << "matches scalar reference." << std::endl;
+		} else {
+			std::cout << mismatches << " mismatches against scalar reference!" << std::endl;
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	std::string png_dir = data_path("../source_png");
+	std::string corpus_dir;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--filter" && argi + 1 < argc) {
+			filter = argv[++argi];
+		} else if (arg == "--pngs" && argi + 1 < argc) {
+			png_dir = argv[++argi];
+		} else if (arg == "--corpus" && argi + 1 < argc) {
+			corpus_dir = argv[++argi];
+		} else {
+			std::cerr << "Usage:\n  " << argv[0] << " [--filter <substring>] [--pngs <path-to-png-directory>] [--corpus <path-to-corpus-directory>]" << std::endl;
+			return 1;
+		}
+	}
+
+	if (!check_tile_codecs()) return 1;
+
+	std::cout << std::left << std::setw(36) << "benchmark" << std::right
+		<< std::setw(12) << "ns/op" << std::setw(12) << "p50" << std::setw(12) << "p95"
+		<< std::setw(12) << "p99" << std::setw(12) << "max" << std::setw(12) << "allocs/op" << std::endl;
+
+	//------------ PPU466 ------------
+
+	static PPU466::Framebuffer framebuffer;
+
+	{ //full-frame software rasterization of a busy (random) PPU state:
+		static PPU466 ppu;
+		randomize(&ppu);
+		benchmark("ppu/draw_software", [&]() {
+			ppu.draw_software(&framebuffer);
+			sink = sink + framebuffer[PPU466::ScreenWidth * 100 + 100].r;
+		});
+	}
+
+	{ //expanding a full set of 4x4-tile metasprites into the per-frame sprite list:
+		static PPU466 ppu;
+		static std::array< uint8_t, 16 > tile_indices;
+		for (uint32_t i = 0; i < tile_indices.size(); ++i) tile_indices[i] = uint8_t(i);
+		for (uint32_t i = 0; i < ppu.metasprites.size(); ++i) {
+			PPU466::Metasprite &meta = ppu.metasprites[i];
+			meta.x = uint8_t(i * 15);
+			meta.y = uint8_t(i * 13);
+			meta.width = meta.height = 32;
+			meta.tile_indices = tile_indices.data();
+		}
+		static PPU466::SpriteList list;
+		benchmark("ppu/list_sprites", [&]() {
+			sink = sink + ppu.list_sprites(&list);
+		});
+	}
+
+	{ //the same, for the 128-sprite, 512-tile configuration:
+		static PPU466Dense ppu;
+		randomize(&ppu);
+		static PPU466Dense::Framebuffer dense_framebuffer;
+		benchmark("ppu/draw_software(dense)", [&]() {
+			ppu.draw_software(&dense_framebuffer);
+			sink = sink + dense_framebuffer[PPU466Dense::ScreenWidth * 100 + 100].r;
+		});
+	}
+
+	{ //the tile table -> 128x128 index texture decode done by PPU466::draw when tiles change, per codec:
+		static PPU466 ppu;
+		randomize(&ppu);
+		static std::array< uint8_t, 128 * 128 > data;
+		for (TileCodec const &codec : tile_codecs()) {
+			benchmark("tile/decode_table(" + std::string(codec.name) + ")", [&]() {
+				for (uint32_t i = 0; i < ppu.tile_table.size(); ++i) {
+					codec.decode(ppu.tile_table[i], &data[(i % 16) * 8 + 128 * ((i / 16) * 8)], 128);
+				}
+				sink = sink + data[1000];
+			});
+		}
+
+		//the inverse, as used by the asset converter when cutting tiles out of images:
+		static std::array< std::array< uint8_t, 64 >, 256 > indices;
+		for (uint32_t i = 0; i < ppu.tile_table.size(); ++i) {
+			tile_codecs()[0].decode(ppu.tile_table[i], indices[i].data(), 8);
+		}
+		for (TileCodec const &codec : tile_codecs()) {
+			benchmark("tile/encode_table(" + std::string(codec.name) + ")", [&]() {
+				for (uint32_t i = 0; i < indices.size(); ++i) {
+					ppu.tile_table[i] = codec.encode(indices[i].data());
+				}
+				sink = sink + ppu.tile_table[17].bit0[3];
+			});
+		}
+	}
+
+	//------------ PlayMode ------------
+
+	{ //one frame of update + draw, with the space key pressed on a fixed schedule:
+		PPU466::headless_framebuffer = &framebuffer;
+		PlayMode play;
+		uint32_t frame = 0;
+		benchmark("playmode/update+draw", [&]() {
+			SDL_Event evt;
+			evt.type = 0;
+			if (frame % 90 == 0) evt.type = SDL_KEYDOWN;
+			if (frame % 90 == 20) evt.type = SDL_KEYUP;
+			if (evt.type != 0) {
+				evt.key.keysym.sym = SDLK_SPACE;
+				play.handle_event(evt, glm::uvec2(PPU466::ScreenWidth, PPU466::ScreenHeight));
+			}
+			play.update(1.0f / 60.0f);
+			play.draw(glm::uvec2(PPU466::ScreenWidth, PPU466::ScreenHeight), 0.5f);
+			frame += 1;
+			sink = sink + framebuffer[0].r;
+		});
+		PPU466::headless_framebuffer = nullptr;
+	}
+
+	//------------ asset loading ------------
+
+	{
+		std::string bundle_file = data_path(Converter::BUNDLE_FILE);
+		benchmark("assets/open_bundle", [&]() {
+			AssetBundle bundle(bundle_file);
+			sink = sink + bundle.section< PPU466::Tile >(Converter::TILE_MAGIC).size;
+		});
+
+		AssetBundle bundle(bundle_file);
+		benchmark("assets/read_asset_infos(bundle)", [&]() {
+			std::vector< AssetInfo > infos;
+			read_asset_infos(bundle, &infos);
+			sink = sink + infos.size();
+		});
+
+		//for comparison, the same data as standalone chunks
+		//(built in memory once, so these measure parsing rather than disk access)
+		ChunkView< PPU466::Tile > tile_data = bundle.section< PPU466::Tile >(Converter::TILE_MAGIC);
+		std::ostringstream tiles_out;
+		write_chunk(Converter::TILE_MAGIC, std::vector< PPU466::Tile >(tile_data.begin(), tile_data.end()), &tiles_out);
+		std::string tiles = tiles_out.str();
+		benchmark("chunk/read_chunk(tiles)", [&]() {
+			std::istringstream from(tiles);
+			std::vector< PPU466::Tile > converted_tiles;
+			read_chunk(from, Converter::TILE_MAGIC, &converted_tiles);
+			sink = sink + converted_tiles.size();
+		});
+		benchmark("chunk/view_chunk(tiles)", [&]() {
+			size_t at = 0;
+			ChunkView< PPU466::Tile > view = view_chunk< PPU466::Tile >(tiles.data(), tiles.size(), &at, Converter::TILE_MAGIC);
+			sink = sink + view.size;
+		});
+
+		std::vector< AssetInfo > bundle_infos;
+		read_asset_infos(bundle, &bundle_infos);
+		std::ostringstream asset_infos_out;
+		write_asset_info_chunk(bundle_infos, &asset_infos_out);
+		std::string asset_infos = asset_infos_out.str();
+		benchmark("chunk/read_asset_info_chunk", [&]() {
+			std::istringstream from(asset_infos);
+			std::vector< AssetInfo > infos;
+			read_asset_info_chunk(from, &infos);
+			sink = sink + infos.size();
+		});
+		benchmark("chunk/read_asset_info_chunk(in place)", [&]() {
+			std::vector< AssetInfo > infos;
+			read_asset_info_chunk(asset_infos.data(), asset_infos.size(), &infos);
+			sink = sink + infos.size();
+		});
+
+		//compressed vs raw: bytes that would be read from disk, and time to get the data back
+		std::vector< PPU466::Tile > tile_vector(tile_data.begin(), tile_data.end());
+		for (int level : {1, 6, 9}) {
+			std::string level_name = "level " + std::to_string(level);
+			std::ostringstream compressed_out;
+			write_compressed_chunk(Converter::TILE_MAGIC, tile_vector, &compressed_out, level);
+			std::string compressed = compressed_out.str();
+			std::string read_name = "chunk/read_chunk(tiles, " + level_name + ")";
+			if (read_name.find(filter) != std::string::npos) {
+				std::cout << "(tiles chunk: " << tiles.size() << " bytes raw, " << compressed.size() << " bytes at " << level_name << ")" << std::endl;
+			}
+			benchmark("chunk/deflate(tiles, " + level_name + ")", [&]() {
+				std::ostringstream to;
+				write_compressed_chunk(Converter::TILE_MAGIC, tile_vector, &to, level);
+				sink = sink + to.tellp();
+			});
+			benchmark(read_name, [&]() {
+				std::istringstream from(compressed);
+				std::vector< PPU466::Tile > converted_tiles;
+				read_chunk(from, Converter::TILE_MAGIC, &converted_tiles);
+				sink = sink + converted_tiles.size();
+			});
+		}
+	}
+
+	//------------ asset converter ------------
+
+	if (std::ifstream(png_dir + "/char_stand.png")) {
+		ConvertOptions options;
+		options.verbose = false;
+		benchmark("converter/parse_pngs", [&]() {
+			parse_pngs(png_dir, options);
+		});
+		options.reuse_mirrored_tiles = true;
+		benchmark("converter/parse_pngs(mirror)", [&]() {
+			parse_pngs(png_dir, options);
+		});
+		//after the first run, every png is found unchanged in the manifest:
+		options.reuse_mirrored_tiles = false;
+		options.manifest_path = "ppu_bench_manifest.chunk";
+		benchmark("converter/parse_pngs(incremental)", [&]() {
+			parse_pngs(png_dir, options);
+		});
+		std::remove(options.manifest_path.c_str());
+	} else {
+		std::cout << "(skipping converter/parse_pngs: no .png files found in '" << png_dir << "'; pass --pngs <dir>)" << std::endl;
+	}
+
+	if (!corpus_dir.empty()) {
+		corpus_throughput(corpus_dir);
+	}
+
+	return 0;
+}
@@ -0,0 +1,112 @@
+#include "read_write_chunk.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <climits>
+
+//------------ inflate ------------
+
+//input is handed to zlib in blocks of at most this many bytes (so streams never need the whole chunk in memory):
+static constexpr size_t InflateBlock = 16384;
+
+namespace {
+//owns a z_stream set up for inflate:
+struct Inflater {
+	Inflater() {
+		if (inflateInit(&stream) != Z_OK) throw std::runtime_error("Failed to initialize zlib inflate.");
+	}
+	~Inflater() {
+		inflateEnd(&stream);
+	}
+	z_stream stream = {};
+
+	void set_output(void *to, size_t size) {
+		assert(size <= UINT_MAX);
+		static Bytef empty; //(zlib rejects a null output pointer, even with no room)
+		stream.next_out = size ? reinterpret_cast< Bytef * >(to) : &empty;
+		stream.avail_out = uInt(size);
+	}
+
+	//inflates stream.avail_in bytes at stream.next_in into the remaining output, returns true at end of stream:
+	bool step() {
+		while (stream.avail_in > 0) {
+			int ret = inflate(&stream, Z_NO_FLUSH);
+			if (ret == Z_STREAM_END) return true;
+			if (ret == Z_BUF_ERROR && stream.avail_out == 0) {
+				throw std::runtime_error("Compressed chunk inflates to more than its stated size.");
+			}
+			if (ret != Z_OK) throw std::runtime_error("Compressed chunk data is corrupt.");
+		}
+		return false;
+	}
+};
+}
+
+void inflate_chunk_data(std::istream &from, size_t compressed_size, void *to, size_t size) {
+	Inflater inflater;
+	inflater.set_output(to, size);
+
+	std::vector< char > block(std::min(compressed_size, InflateBlock));
+	bool done = false;
+	while (compressed_size > 0) {
+		size_t count = std::min(compressed_size, block.size());
+		if (!from.read(block.data(), count)) {
+			throw std::runtime_error("Failed to read compressed chunk data.");
+		}
+		compressed_size -= count;
+		if (done) continue; //(ignore anything after the end of the zlib stream)
+		inflater.stream.next_in = reinterpret_cast< Bytef * >(block.data());
+		inflater.stream.avail_in = uInt(count);
+		done = inflater.step();
+	}
+	if (!done || inflater.stream.avail_out != 0) {
+		throw std::runtime_error("Compressed chunk inflates to less than its stated size.");
+	}
+}
+
+void inflate_chunk_data(void const *from, size_t compressed_size, void *to, size_t size) {
+	Inflater inflater;
+	inflater.set_output(to, size);
+
+	Bytef const *at = reinterpret_cast< Bytef const * >(from);
+	bool done = false;
+	while (compressed_size > 0 && !done) {
+		size_t count = std::min(compressed_size, size_t(UINT_MAX));
+		inflater.stream.next_in = const_cast< Bytef * >(at); //(zlib doesn't write through next_in)
+		inflater.stream.avail_in = uInt(count);
+		done = inflater.step();
+		at += count;
+		compressed_size -= count;
+	}
+	if (!done || inflater.stream.avail_out != 0) {
+		throw std::runtime_error("Compressed chunk inflates to less than its stated size.");
+	}
+}
+
+//------------ deflate ------------
+
+void deflate_chunk_data(void const *data, size_t size, int level, std::vector< char > *to_) {
+	assert(to_);
+	auto &to = *to_;
+	if (level < 1 || level > 9) throw std::runtime_error("zlib compression level must be 1 ... 9.");
+	if (size > UINT_MAX) throw std::runtime_error("Chunk is too large to compress.");
+
+	z_stream stream = {};
+	if (deflateInit(&stream, level) != Z_OK) throw std::runtime_error("Failed to initialize zlib deflate.");
+
+	//compress straight into the end of 'to', sized for the worst case:
+	size_t start = to.size();
+	uLong bound = deflateBound(&stream, uLong(size));
+	to.resize(start + bound);
+	stream.next_in = const_cast< Bytef * >(reinterpret_cast< Bytef const * >(data)); //(zlib doesn't write through next_in)
+	stream.avail_in = uInt(size);
+	stream.next_out = reinterpret_cast< Bytef * >(to.data() + start);
+	stream.avail_out = uInt(bound);
+	int ret = deflate(&stream, Z_FINISH);
+	size_t written = bound - stream.avail_out;
+	deflateEnd(&stream);
+	if (ret != Z_STREAM_END) throw std::runtime_error("Failed to compress chunk data.");
+
+	to.resize(start + written);
+}
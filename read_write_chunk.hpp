@@ -4,12 +4,32 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
 // |ma|gi|c.|..| <-- four byte "magic number"
 // |sz|sz|sz|sz| <-- four byte (native endian) size
 // |TT...TT| * (sz/sizeof(TT)) <-- enough T structures to make up sz bytes
+//
+//...or, for a chunk written with write_compressed_chunk:
+// |ma|gi|c.|..| <-- four byte "magic number"
+// |sz|sz|sz|sz| <-- four byte (native endian) size of the rest of the chunk, with CompressedChunkFlag set
+// |rs|rs|rs|rs| <-- four byte (native endian) size of the data once inflated
+// |zz...zz| <-- zlib stream holding the TT...TT data
+//(read_chunk reads either kind)
+
+constexpr uint32_t CompressedChunkFlag = 0x80000000;
+
+//zlib helpers for compressed chunks (in read_write_chunk.cpp):
+//inflates exactly 'compressed_size' bytes from 'from' into exactly 'size' bytes at 'to', a block at a time:
+void inflate_chunk_data(std::istream &from, size_t compressed_size, void *to, size_t size);
+//same, from a buffer:
+void inflate_chunk_data(void const *from, size_t compressed_size, void *to, size_t size);
+//deflates 'size' bytes at 'data' at zlib level 'level' (1 = fastest ... 9 = smallest), appending to *to:
+void deflate_chunk_data(void const *data, size_t size, int level, std::vector< char > *to);
 
 template< typename T >
 void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *to_) {
@@ -30,6 +50,20 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 		throw std::runtime_error("Unexpected magic number in chunk");
 	}
 
+	if (header.size & CompressedChunkFlag) {
+		uint32_t compressed_size = header.size & ~CompressedChunkFlag;
+		uint32_t raw_size = 0;
+		if (compressed_size < sizeof(raw_size) || !from.read(reinterpret_cast< char * >(&raw_size), sizeof(raw_size))) {
+			throw std::runtime_error("Failed to read compressed chunk header");
+		}
+		if (raw_size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		to.resize(raw_size / sizeof(T));
+		inflate_chunk_data(from, compressed_size - sizeof(raw_size), to.data(), raw_size);
+		return;
+	}
+
 	if (header.size % sizeof(T) != 0) {
 		throw std::runtime_error("Size of chunk not divisible by element size");
 	}
@@ -41,6 +75,73 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 }
 
 
+//a read-only view of an array of T that lives in someone else's buffer (nothing is copied):
+template< typename T >
+struct ChunkView {
+	T const *data = nullptr;
+	size_t size = 0;
+
+	T const *begin() const { return data; }
+	T const *end() const { return data + size; }
+	bool empty() const { return size == 0; }
+	T const &operator[](size_t i) const {
+		assert(i < size);
+		return data[i];
+	}
+};
+
+//helper function that views 'bytes' bytes at 'data' as an array of T, checking size and alignment:
+template< typename T >
+ChunkView< T > view_array(void const *data, size_t bytes) {
+	if (bytes % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (reinterpret_cast< uintptr_t >(data) % alignof(T) != 0) {
+		throw std::runtime_error("Chunk data is not aligned for its element type");
+	}
+	ChunkView< T > view;
+	view.data = reinterpret_cast< T const * >(data);
+	view.size = bytes / sizeof(T);
+	return view;
+}
+
+//helper function that parses a chunk in the same format as read_chunk, in place in a contiguous buffer
+// (e.g., a memory-mapped file or an embedded blob) of 'size' bytes at 'data':
+// the chunk starts at *at_, which is advanced past it so that consecutive chunks can be viewed in turn.
+//The returned view points into 'data', so is only valid as long as 'data' is.
+template< typename T >
+ChunkView< T > view_chunk(void const *data, size_t size, size_t *at_, std::string const &magic) {
+	assert(magic.size() == 4);
+	assert(at_);
+	auto &at = *at_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	uint8_t const *bytes = reinterpret_cast< uint8_t const * >(data);
+	ChunkHeader header;
+	if (at > size || size - at < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, bytes + at, sizeof(header)); //(the header itself need not be aligned)
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+	if (header.size & CompressedChunkFlag) {
+		throw std::runtime_error("Compressed chunks can't be viewed in place (use read_chunk)");
+	}
+	if (header.size > size - at - sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	ChunkView< T > view = view_array< T >(bytes + at + sizeof(header), header.size);
+	at += sizeof(header) + header.size;
+	return view;
+}
+
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
 void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
@@ -58,8 +159,44 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	header.magic[1] = magic[1];
 	header.magic[2] = magic[2];
 	header.magic[3] = magic[3];
+	if (from.size() * sizeof(T) >= CompressedChunkFlag) {
+		throw std::runtime_error("Chunk is too large"); //(the size would read as a compressed chunk)
+	}
 	header.size = uint32_t(from.size() * sizeof(T));
 
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+//helper function to write a compressed chunk that read_chunk can read
+// ('level' is the zlib level, 1 = fastest ... 9 = smallest):
+template< typename T >
+void write_compressed_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_, int level = 6) {
+	assert(magic.size() == 4);
+	assert(to_);
+	auto &to = *to_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+		uint32_t raw_size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 12, "header is packed");
+
+	std::vector< char > compressed;
+	deflate_chunk_data(from.data(), from.size() * sizeof(T), level, &compressed);
+	if (sizeof(uint32_t) + compressed.size() >= CompressedChunkFlag) {
+		throw std::runtime_error("Chunk is too large to compress");
+	}
+
+	ChunkHeader header;
+	header.magic[0] = magic[0];
+	header.magic[1] = magic[1];
+	header.magic[2] = magic[2];
+	header.magic[3] = magic[3];
+	header.size = uint32_t(sizeof(header.raw_size) + compressed.size()) | CompressedChunkFlag;
+	header.raw_size = uint32_t(from.size() * sizeof(T));
+
+	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
+	to.write(compressed.data(), compressed.size());
+}
@@ -0,0 +1,204 @@
+#include "tile_codec.hpp"
+
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define TILE_CODEC_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define TARGET_AVX2 //MSVC allows AVX2 intrinsics in any function
+	#else
+		#define TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+//------------ scalar reference ------------
+
+static void decode_scalar(PPU466::Tile const &tile, uint8_t *indices, size_t stride) {
+	for (uint32_t y = 0; y < 8; ++y) {
+		for (uint32_t x = 0; x < 8; ++x) {
+			indices[x + stride * y] = uint8_t(
+				  ((tile.bit0[y] >> x) & 1)
+				| ((tile.bit1[y] >> x) & 1) << 1
+			);
+		}
+	}
+}
+
+static PPU466::Tile encode_scalar(uint8_t const *indices) {
+	PPU466::Tile tile;
+	for (uint32_t y = 0; y < 8; ++y) {
+		uint8_t bit0 = 0;
+		uint8_t bit1 = 0;
+		for (uint32_t x = 0; x < 8; ++x) {
+			bit0 |= uint8_t(( indices[x + 8 * y]       & 1) << x);
+			bit1 |= uint8_t(((indices[x + 8 * y] >> 1) & 1) << x);
+		}
+		tile.bit0[y] = bit0;
+		tile.bit1[y] = bit1;
+	}
+	return tile;
+}
+
+#ifdef TILE_CODEC_X86
+
+//------------ SSE2 ------------
+//Decoding repeats each bit plane byte across eight lanes, then tests one bit per lane.
+//Encoding shifts the wanted index bit into each byte's high bit and gathers them with movemask.
+
+//expand each of the eight copies of a row byte to 0 or 1 depending on bit (lane % 8):
+static inline __m128i test_bits_sse2(__m128i rows) {
+	const __m128i bits = _mm_setr_epi8(1,2,4,8,16,32,64,-128, 1,2,4,8,16,32,64,-128);
+	return _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(rows, bits), bits), _mm_set1_epi8(1));
+}
+
+static void decode_sse2(PPU466::Tile const &tile, uint8_t *indices, size_t stride) {
+	__m128i planes[2] = {
+		_mm_loadl_epi64(reinterpret_cast< __m128i const * >(tile.bit0.data())),
+		_mm_loadl_epi64(reinterpret_cast< __m128i const * >(tile.bit1.data()))
+	};
+	//rows[p][k] holds rows 2k and 2k+1 of plane p, each byte repeated eight times:
+	__m128i rows[2][4];
+	for (uint32_t p = 0; p < 2; ++p) {
+		__m128i x2 = _mm_unpacklo_epi8(planes[p], planes[p]);
+		__m128i x4_lo = _mm_unpacklo_epi16(x2, x2);
+		__m128i x4_hi = _mm_unpackhi_epi16(x2, x2);
+		rows[p][0] = _mm_unpacklo_epi32(x4_lo, x4_lo);
+		rows[p][1] = _mm_unpackhi_epi32(x4_lo, x4_lo);
+		rows[p][2] = _mm_unpacklo_epi32(x4_hi, x4_hi);
+		rows[p][3] = _mm_unpackhi_epi32(x4_hi, x4_hi);
+	}
+	for (uint32_t k = 0; k < 4; ++k) {
+		//lanes hold 0 or 1, so a 16-bit shift can't carry between bytes:
+		__m128i idx = _mm_or_si128(test_bits_sse2(rows[0][k]), _mm_slli_epi16(test_bits_sse2(rows[1][k]), 1));
+		_mm_storel_epi64(reinterpret_cast< __m128i * >(indices + stride * (2 * k)), idx);
+		_mm_storel_epi64(reinterpret_cast< __m128i * >(indices + stride * (2 * k + 1)), _mm_srli_si128(idx, 8));
+	}
+}
+
+static PPU466::Tile encode_sse2(uint8_t const *indices) {
+	PPU466::Tile tile;
+	for (uint32_t k = 0; k < 4; ++k) {
+		__m128i idx = _mm_loadu_si128(reinterpret_cast< __m128i const * >(indices + 16 * k));
+		//within each 16-bit lane, shifting left by 7 (or 6) moves bit 0 (or 1) of both bytes to their high bits:
+		uint32_t bit0 = uint32_t(_mm_movemask_epi8(_mm_slli_epi16(idx, 7)));
+		uint32_t bit1 = uint32_t(_mm_movemask_epi8(_mm_slli_epi16(idx, 6)));
+		tile.bit0[2 * k] = uint8_t(bit0);
+		tile.bit0[2 * k + 1] = uint8_t(bit0 >> 8);
+		tile.bit1[2 * k] = uint8_t(bit1);
+		tile.bit1[2 * k + 1] = uint8_t(bit1 >> 8);
+	}
+	return tile;
+}
+
+//------------ AVX2 ------------
+//Same approach, four rows at a time; the byte shuffle picks which row byte each lane sees.
+
+TARGET_AVX2 static inline __m256i test_bits_avx2(__m256i rows) {
+	const __m256i bits = _mm256_setr_epi8(
+		1,2,4,8,16,32,64,-128, 1,2,4,8,16,32,64,-128,
+		1,2,4,8,16,32,64,-128, 1,2,4,8,16,32,64,-128
+	);
+	return _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(rows, bits), bits), _mm256_set1_epi8(1));
+}
+
+TARGET_AVX2 static void decode_avx2(PPU466::Tile const &tile, uint8_t *indices, size_t stride) {
+	static_assert(offsetof(PPU466::Tile, bit1) == 8, "bit planes are adjacent");
+	//both 128-bit lanes hold bit0[0..7], bit1[0..7]:
+	__m256i planes = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast< __m128i const * >(&tile)));
+
+	//(shuffles stay within 128-bit lanes, so the second lane's indices pick the next two rows)
+	#define ROW_PAIR(A,B) A,A,A,A,A,A,A,A, B,B,B,B,B,B,B,B
+	const __m256i select[2][2] = {
+		{ _mm256_setr_epi8(ROW_PAIR(0,1), ROW_PAIR(2,3)), _mm256_setr_epi8(ROW_PAIR(8,9), ROW_PAIR(10,11)) },
+		{ _mm256_setr_epi8(ROW_PAIR(4,5), ROW_PAIR(6,7)), _mm256_setr_epi8(ROW_PAIR(12,13), ROW_PAIR(14,15)) },
+	};
+	#undef ROW_PAIR
+
+	for (uint32_t half = 0; half < 2; ++half) {
+		__m256i idx = _mm256_or_si256(
+			test_bits_avx2(_mm256_shuffle_epi8(planes, select[half][0])),
+			_mm256_slli_epi16(test_bits_avx2(_mm256_shuffle_epi8(planes, select[half][1])), 1)
+		);
+		//idx holds rows 4*half .. 4*half+3, in order:
+		if (stride == 8) {
+			_mm256_storeu_si256(reinterpret_cast< __m256i * >(indices + 32 * half), idx);
+		} else {
+			__m128i lo = _mm256_castsi256_si128(idx);
+			__m128i hi = _mm256_extracti128_si256(idx, 1);
+			_mm_storel_epi64(reinterpret_cast< __m128i * >(indices + stride * (4 * half + 0)), lo);
+			_mm_storel_epi64(reinterpret_cast< __m128i * >(indices + stride * (4 * half + 1)), _mm_srli_si128(lo, 8));
+			_mm_storel_epi64(reinterpret_cast< __m128i * >(indices + stride * (4 * half + 2)), hi);
+			_mm_storel_epi64(reinterpret_cast< __m128i * >(indices + stride * (4 * half + 3)), _mm_srli_si128(hi, 8));
+		}
+	}
+}
+
+TARGET_AVX2 static PPU466::Tile encode_avx2(uint8_t const *indices) {
+	PPU466::Tile tile;
+	for (uint32_t half = 0; half < 2; ++half) {
+		__m256i idx = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(indices + 32 * half));
+		uint32_t bit0 = uint32_t(_mm256_movemask_epi8(_mm256_slli_epi16(idx, 7)));
+		uint32_t bit1 = uint32_t(_mm256_movemask_epi8(_mm256_slli_epi16(idx, 6)));
+		for (uint32_t r = 0; r < 4; ++r) {
+			tile.bit0[4 * half + r] = uint8_t(bit0 >> (8 * r));
+			tile.bit1[4 * half + r] = uint8_t(bit1 >> (8 * r));
+		}
+	}
+	return tile;
+}
+
+//------------ CPU feature detection ------------
+
+static bool cpu_has_sse2() {
+	#if defined(__x86_64__) || defined(_M_X64)
+	return true; //always present on x86-64
+	#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+	#else
+	return __builtin_cpu_supports("sse2");
+	#endif
+}
+
+static bool cpu_has_avx2() {
+	#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx) return false;
+	if ((_xgetbv(0) & 0x6) != 0x6) return false; //OS must save ymm registers
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+	#else
+	return __builtin_cpu_supports("avx2");
+	#endif
+}
+
+#endif //TILE_CODEC_X86
+
+//------------ dispatch ------------
+
+std::vector< TileCodec > const &tile_codecs() {
+	static std::vector< TileCodec > codecs = [](){
+		std::vector< TileCodec > ret;
+		ret.emplace_back(TileCodec{ "scalar", decode_scalar, encode_scalar });
+		#ifdef TILE_CODEC_X86
+		if (cpu_has_sse2()) ret.emplace_back(TileCodec{ "sse2", decode_sse2, encode_sse2 });
+		if (cpu_has_avx2()) ret.emplace_back(TileCodec{ "avx2", decode_avx2, encode_avx2 });
+		#endif
+		return ret;
+	}();
+	return codecs;
+}
+
+TileCodec const &tile_codec() {
+	//implementations are listed slowest to fastest:
+	static TileCodec const &codec = tile_codecs().back();
+	return codec;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+/*
+ * Conversion between PPU466::Tile bit planes and 8x8 images of color indices.
+ *
+ * An index image has one byte per pixel, row-major, with the bottom row first:
+ *   indices[x + stride * y] is the color index (0-3) of pixel (x,y)
+ *   (this matches the bit plane layout described in PPU466.hpp)
+ *
+ * There are several implementations (scalar, SSE2, AVX2); decode_tile() and encode_tile() use
+ * the fastest one the CPU supports, chosen once at startup.
+ */
+
+#include "PPU466.hpp"
+
+#include <cstddef>
+#include <vector>
+
+struct TileCodec {
+	char const *name;
+	//write the tile's 64 color indices, with rows 'stride' bytes apart:
+	void (*decode)(PPU466::Tile const &tile, uint8_t *indices, size_t stride);
+	//build a tile from 64 color indices (rows 8 bytes apart); only the low two bits of each index are used:
+	PPU466::Tile (*encode)(uint8_t const *indices);
+};
+
+//every implementation that can run on this CPU, starting with the scalar reference:
+std::vector< TileCodec > const &tile_codecs();
+
+//the implementation used by decode_tile() and encode_tile():
+TileCodec const &tile_codec();
+
+inline void decode_tile(PPU466::Tile const &tile, uint8_t *indices, size_t stride = 8) {
+	tile_codec().decode(tile, indices, stride);
+}
+
+inline PPU466::Tile encode_tile(uint8_t const *indices) {
+	return tile_codec().encode(indices);
+}